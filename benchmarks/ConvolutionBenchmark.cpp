@@ -0,0 +1,204 @@
+// Measures the cost and the accuracy of the HRIR length tiers.
+//
+// Every tier is convolved with the same stereo noise at several host block sizes,
+// the result is the average time per block and the cost relative to the longest
+// impulse response. The accuracy is measured on the measured hutubs dataset: every
+// filter is cut to the tier the way the plugin does it, and compared with the full
+// length one. The error is the energy of the difference relative to the energy of
+// the full filter, as the mean over all filters and for the worst one, along with
+// the energy the worst filter keeps.
+// Build with -DORBE_BUILD_BENCHMARKS=ON and run OrbeBenchmarks.
+
+#include <JuceHeader.h>
+#include <BinaryData.h>
+#include <mysofa.h>
+#include "../source/dsp/HRIRSet.h"
+#include "../source/dsp/convolution/custom_juce_Convolution.h"
+#include "../source/dsp/convolution/custom_juce_FFTBackend.h"
+
+namespace
+{
+    constexpr double sampleRate = 48000.0;
+    constexpr int numChannels = 2;
+    constexpr int numBlocksToMeasure = 20000;
+
+    // decaying noise, shaped roughly like a measured hrir
+    juce::AudioBuffer<float> makeImpulseResponse(int length, juce::Random& random)
+    {
+        juce::AudioBuffer<float> buffer(numChannels, length);
+
+        for (int channel = 0; channel < numChannels; ++channel)
+            for (int n = 0; n < length; ++n)
+                buffer.setSample(channel, n, (random.nextFloat() * 2.0f - 1.0f) * std::exp(-6.0f * static_cast<float>(n) / static_cast<float>(length)));
+
+        return buffer;
+    }
+
+    double measureMicrosecondsPerBlock(int irLength, int blockSize)
+    {
+        juce::Random random(irLength);
+        juce::AudioBuffer<float> buffer(numChannels, blockSize);
+
+        // mono source, like the plugin
+        custom_juce::Convolution convolution;
+        convolution.setMonoInput(true);
+        convolution.prepare({ sampleRate, static_cast<juce::uint32>(blockSize), static_cast<juce::uint32>(numChannels) });
+        convolution.loadImpulseResponse(makeImpulseResponse(irLength, random), sampleRate,
+                                        custom_juce::Convolution::Stereo::yes,
+                                        custom_juce::Convolution::Trim::no,
+                                        custom_juce::Convolution::Normalise::no);
+
+        const auto processBlock = [&]
+        {
+            for (int channel = 0; channel < numChannels; ++channel)
+                for (int n = 0; n < blockSize; ++n)
+                    buffer.setSample(channel, n, random.nextFloat() * 2.0f - 1.0f);
+
+            juce::dsp::AudioBlock<float> block(buffer);
+            convolution.process(juce::dsp::ProcessContextReplacing<float>(block));
+        };
+
+        // the engine is built in the background, then crossfaded in
+        while (convolution.getCurrentIRSize() != irLength)
+        {
+            processBlock();
+            juce::Thread::sleep(1);
+        }
+
+        for (int i = 0; i < juce::roundToInt(sampleRate / blockSize); ++i)
+            processBlock();
+
+        const auto start = juce::Time::getHighResolutionTicks();
+
+        for (int i = 0; i < numBlocksToMeasure; ++i)
+            processBlock();
+
+        const auto seconds = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - start);
+        return 1.0e6 * seconds / numBlocksToMeasure;
+    }
+
+    std::unique_ptr<HRIRSet> loadMeasuredDataset(int maxLength, juce::ThreadPool& pool)
+    {
+        int err = 0;
+        auto hrtf = mysofa_load_data(BinaryData::pp2_HRIRs_measured_time_aligned_sofa,
+                                     BinaryData::pp2_HRIRs_measured_time_aligned_sofaSize,
+                                     &err);
+
+        if (hrtf != nullptr && err == MYSOFA_OK)
+            err = mysofa_check(hrtf);
+
+        if (hrtf == nullptr || err != MYSOFA_OK)
+        {
+            if (hrtf != nullptr)
+                mysofa_free(hrtf);
+
+            return nullptr;
+        }
+
+        mysofa_tocartesian(hrtf);
+
+        HRIRProcessing processing;
+        processing.maxLength = maxLength;
+
+        auto set = HRIRSet::createFromSofa(hrtf, sampleRate, BinaryData::pp2_HRIRs_measured_time_aligned_sofaSize, processing, pool);
+        mysofa_free(hrtf);
+        return set;
+    }
+
+    struct Accuracy
+    {
+        double meanErrorDb = 0.0;
+        double worstErrorDb = -200.0;
+        double worstEnergyDb = 0.0;
+    };
+
+    Accuracy measureAccuracy(const HRIRSet& full, const HRIRSet& truncated)
+    {
+        Accuracy accuracy;
+        double errorSum = 0.0;
+        int numFilters = 0;
+
+        for (int i = 0; i < full.getNumMeasurements(); ++i)
+        {
+            for (int ear = 0; ear < 2; ++ear)
+            {
+                const auto* reference = full.getIR(i, ear);
+                const auto* cut = truncated.getIR(i, ear);
+
+                double energy = 0.0, cutEnergy = 0.0, error = 0.0;
+
+                for (int n = 0; n < full.getIRLength(); ++n)
+                {
+                    const auto sample = n < truncated.getIRLength() ? static_cast<double>(cut[n]) : 0.0;
+                    energy += static_cast<double>(reference[n]) * reference[n];
+                    cutEnergy += sample * sample;
+                    error += (sample - reference[n]) * (sample - reference[n]);
+                }
+
+                if (energy <= 0.0)
+                    continue;
+
+                errorSum += error / energy;
+                ++numFilters;
+
+                accuracy.worstErrorDb = juce::jmax(accuracy.worstErrorDb, 10.0 * std::log10(juce::jmax(error / energy, 1.0e-20)));
+                accuracy.worstEnergyDb = juce::jmin(accuracy.worstEnergyDb, 10.0 * std::log10(juce::jmax(cutEnergy / energy, 1.0e-20)));
+            }
+        }
+
+        accuracy.meanErrorDb = 10.0 * std::log10(juce::jmax(errorSum / juce::jmax(1, numFilters), 1.0e-20));
+        return accuracy;
+    }
+}
+
+int main()
+{
+    // the last one is the full length, the 256 taps of the hutubs filters resampled to 48 kHz
+    const int irLengths[] = { 64, 128, 256, 279 };
+    const int blockSizes[] = { 32, 64, 128, 256, 512 };
+
+    std::cout << "fft backend: " << custom_juce::FFTBackend::getName(custom_juce::FFTBackend::getDefaultType()) << std::endl;
+    std::cout << "block size | taps | us per block | relative to full length" << std::endl;
+
+    for (auto blockSize : blockSizes)
+    {
+        const auto reference = measureMicrosecondsPerBlock(irLengths[3], blockSize);
+
+        for (auto irLength : irLengths)
+        {
+            const auto time = irLength == irLengths[3] ? reference : measureMicrosecondsPerBlock(irLength, blockSize);
+
+            std::cout << juce::String(blockSize).paddedLeft(' ', 10) << " | "
+                      << juce::String(irLength).paddedLeft(' ', 4) << " | "
+                      << juce::String(time, 3).paddedLeft(' ', 12) << " | "
+                      << juce::String(time / reference, 2) << std::endl;
+        }
+    }
+
+    juce::ThreadPool pool;
+    const auto full = loadMeasuredDataset(0, pool);
+
+    if (full == nullptr)
+    {
+        std::cout << "Could not load the measured dataset" << std::endl;
+        return 1;
+    }
+
+    std::cout << std::endl << "taps | mean error (dB) | worst error (dB) | worst kept energy (dB)" << std::endl;
+
+    for (auto irLength : irLengths)
+    {
+        if (irLength >= full->getIRLength())
+            continue;
+
+        const auto truncated = loadMeasuredDataset(irLength, pool);
+        const auto accuracy = measureAccuracy(*full, *truncated);
+
+        std::cout << juce::String(irLength).paddedLeft(' ', 4) << " | "
+                  << juce::String(accuracy.meanErrorDb, 1).paddedLeft(' ', 15) << " | "
+                  << juce::String(accuracy.worstErrorDb, 1).paddedLeft(' ', 16) << " | "
+                  << juce::String(accuracy.worstEnergyDb, 2) << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,105 @@
+// Compares the FFT backends available to the convolution, per FFT order.
+//
+// Every backend runs a forward and an inverse real-only transform on the same
+// noise, the result is the average time per pair and the largest deviation of
+// its spectrum from the juce one. The fastest backend of every order is marked.
+// Build with -DORBE_BUILD_BENCHMARKS=ON (and -DORBE_USE_FFTW=ON to include FFTW)
+// and run OrbeFFTBenchmarks.
+
+#include <JuceHeader.h>
+#include "../source/dsp/convolution/custom_juce_FFTBackend.h"
+
+namespace
+{
+    using custom_juce::FFTBackend;
+
+    // about the same amount of work for every order
+    constexpr int samplesToTransform = 1 << 24;
+    constexpr int minOrder = 5;
+    constexpr int maxOrder = 13;
+
+    std::vector<float> makeNoise(int size)
+    {
+        juce::Random random(size);
+        std::vector<float> noise(static_cast<size_t>(2 * size), 0.0f);
+
+        for (int n = 0; n < size; ++n)
+            noise[static_cast<size_t>(n)] = random.nextFloat() * 2.0f - 1.0f;
+
+        return noise;
+    }
+
+    std::vector<float> getSpectrum(FFTBackend::Type type, int order)
+    {
+        const auto fft = FFTBackend::create(type, order);
+        auto data = makeNoise(fft->getSize());
+        fft->performRealOnlyForwardTransform(data.data());
+        data.resize(static_cast<size_t>(fft->getSize() + 2));
+        return data;
+    }
+
+    double measureNanosecondsPerPair(FFTBackend::Type type, int order)
+    {
+        const auto fft = FFTBackend::create(type, order);
+        const auto noise = makeNoise(fft->getSize());
+        auto data = noise;
+
+        const auto numIterations = juce::jmax(100, samplesToTransform / fft->getSize());
+
+        // the inverse transform is scaled, so the data stays in range
+        for (int i = 0; i < numIterations / 10; ++i)
+        {
+            fft->performRealOnlyForwardTransform(data.data());
+            fft->performRealOnlyInverseTransform(data.data());
+        }
+
+        const auto start = juce::Time::getHighResolutionTicks();
+
+        for (int i = 0; i < numIterations; ++i)
+        {
+            fft->performRealOnlyForwardTransform(data.data());
+            fft->performRealOnlyInverseTransform(data.data());
+        }
+
+        const auto seconds = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - start);
+        return 1.0e9 * seconds / numIterations;
+    }
+}
+
+int main()
+{
+    const FFTBackend::Type types[] = { FFTBackend::Type::juce, FFTBackend::Type::fftw };
+
+    std::cout << "order | size | backend | ns per forward + inverse | max deviation" << std::endl;
+
+    for (int order = minOrder; order <= maxOrder; ++order)
+    {
+        const auto reference = getSpectrum(FFTBackend::Type::juce, order);
+
+        std::vector<std::pair<FFTBackend::Type, double>> times;
+
+        for (auto type : types)
+            if (FFTBackend::isAvailable(type))
+                times.emplace_back(type, measureNanosecondsPerPair(type, order));
+
+        const auto fastest = std::min_element(times.begin(), times.end(), [](const auto& a, const auto& b) { return a.second < b.second; })->first;
+
+        for (const auto& [type, time] : times)
+        {
+            const auto spectrum = getSpectrum(type, order);
+            float deviation = 0.0f;
+
+            for (size_t i = 0; i < reference.size(); ++i)
+                deviation = juce::jmax(deviation, std::abs(spectrum[i] - reference[i]));
+
+            std::cout << juce::String(order).paddedLeft(' ', 5) << " | "
+                      << juce::String(1 << order).paddedLeft(' ', 4) << " | "
+                      << FFTBackend::getName(type).paddedRight(' ', 7) << " | "
+                      << juce::String(time, 1).paddedLeft(' ', 24) << " | "
+                      << juce::String(deviation, 7)
+                      << (type == fastest ? "  fastest" : "") << std::endl;
+        }
+    }
+
+    return 0;
+}
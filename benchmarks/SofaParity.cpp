@@ -0,0 +1,167 @@
+// Checks the parallel sofa ingestion of HRIRSet against libmysofa.
+//
+// Every bundled dataset is opened twice at several sample rates: once with
+// mysofa_open_data, which resamples with speex and normalises with
+// mysofa_loudness like the loader did before, and once the way SofaReader does
+// it, through HRIRSet::createFromSofa without any processing. The result is the
+// worst deviation of a filter from its reference (error energy relative to the
+// energy of the reference), the gain difference of the whole set and the largest
+// delay difference. The app fails if one of them is out of tolerance.
+// Build with -DORBE_BUILD_BENCHMARKS=ON and run OrbeSofaParity.
+
+#include <JuceHeader.h>
+#include <BinaryData.h>
+#include <mysofa.h>
+#include "../source/dsp/HRIRSet.h"
+
+namespace
+{
+    // the two resamplers differ in their filters, which only shows close to nyquist
+    constexpr double maxFilterErrorDb = -30.0;
+    constexpr double maxGainErrorDb = 0.1;
+    constexpr double maxDelayError = 0.01;
+
+    struct Dataset
+    {
+        const char* name;
+        const char* data;
+        int size;
+    };
+
+    struct Result
+    {
+        double filterErrorDb = -200.0;
+        double gainErrorDb = 0.0;
+        double delayError = 0.0;
+        bool lengthsMatch = false;
+    };
+
+    double toDecibels(double ratio)
+    {
+        return 10.0 * std::log10(juce::jmax(ratio, 1.0e-20));
+    }
+
+    bool compare(const Dataset& dataset, double sampleRate, juce::ThreadPool& pool, Result& result)
+    {
+        int filterLength = 0;
+        int err = 0;
+        auto easy = mysofa_open_data(dataset.data, dataset.size, static_cast<float>(sampleRate), &filterLength, &err);
+
+        if (easy == nullptr || err != MYSOFA_OK)
+            return false;
+
+        auto hrtf = mysofa_load_data(dataset.data, dataset.size, &err);
+
+        if (hrtf != nullptr && err == MYSOFA_OK)
+            err = mysofa_check(hrtf);
+
+        if (hrtf == nullptr || err != MYSOFA_OK)
+        {
+            if (hrtf != nullptr)
+                mysofa_free(hrtf);
+
+            mysofa_close(easy);
+            return false;
+        }
+
+        mysofa_tocartesian(hrtf);
+        const auto set = HRIRSet::createFromSofa(hrtf, sampleRate, dataset.size, HRIRProcessing(), pool);
+        mysofa_free(hrtf);
+
+        const auto* reference = easy->hrtf;
+        const auto length = set->getIRLength();
+        result.lengthsMatch = length == static_cast<int>(reference->N) && set->getNumMeasurements() == static_cast<int>(reference->M);
+
+        if (result.lengthsMatch)
+        {
+            double referenceEnergy = 0.0, setEnergy = 0.0;
+
+            for (int i = 0; i < set->getNumMeasurements(); ++i)
+            {
+                for (int ear = 0; ear < 2; ++ear)
+                {
+                    const auto* expected = reference->DataIR.values + (static_cast<size_t>(i) * reference->R + static_cast<size_t>(ear)) * reference->N;
+                    const auto* actual = set->getIR(i, ear);
+
+                    double energy = 0.0, error = 0.0;
+
+                    for (int n = 0; n < length; ++n)
+                    {
+                        energy += static_cast<double>(expected[n]) * expected[n];
+                        error += static_cast<double>(actual[n] - expected[n]) * (actual[n] - expected[n]);
+                        setEnergy += static_cast<double>(actual[n]) * actual[n];
+                    }
+
+                    referenceEnergy += energy;
+
+                    if (energy > 0.0)
+                        result.filterErrorDb = juce::jmax(result.filterErrorDb, toDecibels(error / energy));
+
+                    // mysofa_resample scales the delays of the file, which are in samples
+                    const auto delayIndex = reference->DataDelay.elements > reference->R ? static_cast<size_t>(i) * reference->R + static_cast<size_t>(ear)
+                                                                                          : static_cast<size_t>(ear);
+                    result.delayError = juce::jmax(result.delayError, std::abs(static_cast<double>(set->getDelay(i, ear) - reference->DataDelay.values[delayIndex])));
+                }
+            }
+
+            result.gainErrorDb = std::abs(toDecibels(setEnergy / referenceEnergy));
+        }
+
+        mysofa_close(easy);
+        return true;
+    }
+}
+
+int main()
+{
+    const Dataset datasets[] = {
+        { "measured", BinaryData::pp2_HRIRs_measured_time_aligned_sofa, BinaryData::pp2_HRIRs_measured_time_aligned_sofaSize },
+        { "interpolated_sh", BinaryData::pp2_HRIRs_interpolated_sh_time_aligned_sofa, BinaryData::pp2_HRIRs_interpolated_sh_time_aligned_sofaSize },
+        { "interpolated_sh_timealign", BinaryData::pp2_HRIRs_interpolated_sh_timealign_time_aligned_sofa, BinaryData::pp2_HRIRs_interpolated_sh_timealign_time_aligned_sofaSize },
+        { "interpolated_mca", BinaryData::pp2_HRIRs_interpolated_mca_time_aligned_sofa, BinaryData::pp2_HRIRs_interpolated_mca_time_aligned_sofaSize },
+    };
+
+    // the native rate of the files, and the usual host rates
+    const double sampleRates[] = { 44100.0, 48000.0, 88200.0, 96000.0 };
+
+    juce::ThreadPool pool;
+    bool passed = true;
+
+    std::cout << "dataset | sample rate | worst filter error (dB) | gain error (dB) | delay error (samples)" << std::endl;
+
+    for (const auto& dataset : datasets)
+    {
+        for (const auto sampleRate : sampleRates)
+        {
+            Result result;
+
+            if (! compare(dataset, sampleRate, pool, result))
+            {
+                std::cout << dataset.name << " | " << sampleRate << " | could not be opened" << std::endl;
+                passed = false;
+                continue;
+            }
+
+            if (! result.lengthsMatch)
+            {
+                std::cout << dataset.name << " | " << sampleRate << " | different number or length of filters" << std::endl;
+                passed = false;
+                continue;
+            }
+
+            const auto ok = result.filterErrorDb <= maxFilterErrorDb
+                         && result.gainErrorDb <= maxGainErrorDb
+                         && result.delayError <= maxDelayError;
+
+            std::cout << dataset.name << " | " << sampleRate
+                      << " | " << juce::String(result.filterErrorDb, 1)
+                      << " | " << juce::String(result.gainErrorDb, 3)
+                      << " | " << juce::String(result.delayError, 3)
+                      << (ok ? "" : " | out of tolerance") << std::endl;
+
+            passed = passed && ok;
+        }
+    }
+
+    return passed ? 0 : 1;
+}
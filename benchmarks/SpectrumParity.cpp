@@ -0,0 +1,137 @@
+// Checks the SIMD kernels of the convolution's complex multiply-accumulate
+// against the scalar one.
+//
+// Every kernel this CPU can run sums random spectra for several numbers of
+// partitions, with and without a partial sum and in both output layouts. The
+// numbers of bins include odd ones, so that the scalar tail after the last full
+// vector is covered as well. The result is the largest deviation from the scalar
+// kernel per summed partition. The app fails if it is out of tolerance, or if a
+// kernel wrote past the end of its output.
+// Build with -DORBE_BUILD_BENCHMARKS=ON and run OrbeSpectrumParity.
+
+#include <JuceHeader.h>
+#include "../source/dsp/convolution/custom_juce_SpectrumProducts.h"
+
+namespace
+{
+    using custom_juce::SpectrumProducts;
+
+    // the kernels sum in another order and with fused multiply-adds, per partition
+    constexpr float maxErrorPerPartition = 1.0e-5f;
+    // written after the output, it has to stay untouched
+    constexpr int numGuardSamples = 16;
+    constexpr float guardValue = 12345.0f;
+
+    std::vector<float> makeSpectrum(juce::Random& random, size_t numBins)
+    {
+        std::vector<float> spectrum(2 * numBins);
+
+        for (auto& value : spectrum)
+            value = random.nextFloat() * 2.0f - 1.0f;
+
+        return spectrum;
+    }
+
+    struct Case
+    {
+        std::vector<std::vector<float>> inputs, impulses;
+        std::vector<const float*> inputPointers, impulsePointers;
+        std::vector<float> partialSum;
+    };
+
+    Case makeCase(juce::Random& random, size_t numBins, size_t numPartitions)
+    {
+        Case c;
+
+        for (size_t i = 0; i < numPartitions; ++i)
+        {
+            c.inputs.push_back(makeSpectrum(random, numBins));
+            c.impulses.push_back(makeSpectrum(random, numBins));
+        }
+
+        for (size_t i = 0; i < numPartitions; ++i)
+        {
+            c.inputPointers.push_back(c.inputs[i].data());
+            c.impulsePointers.push_back(c.impulses[i].data());
+        }
+
+        c.partialSum = makeSpectrum(random, numBins);
+        return c;
+    }
+
+    std::vector<float> run(custom_juce::SpectrumKernel kernel, const Case& c, size_t numBins, bool withPartialSum, bool interleave)
+    {
+        std::vector<float> output(2 * numBins + numGuardSamples, guardValue);
+
+        const SpectrumProducts products { c.inputPointers.data(), c.impulsePointers.data(), c.inputPointers.size(),
+                                          withPartialSum ? c.partialSum.data() : nullptr,
+                                          output.data(), numBins, interleave };
+        kernel(products);
+        return output;
+    }
+}
+
+int main()
+{
+    const size_t binCounts[] = { 1, 2, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 33, 63, 64, 65, 127, 129, 255, 257, 1023, 1025 };
+    const size_t partitionCounts[] = { 1, 2, 3, 8, 17 };
+
+    const auto kernels = custom_juce::getAvailableSpectrumKernels();
+    juce::Random random(42);
+    bool passed = true;
+
+    std::cout << "kernel | worst error per partition" << std::endl;
+
+    for (const auto& kernel : kernels)
+    {
+        float worstError = 0.0f;
+        bool overrun = false;
+
+        for (auto numBins : binCounts)
+        {
+            for (auto numPartitions : partitionCounts)
+            {
+                const auto c = makeCase(random, numBins, numPartitions);
+                // the partial sum counts as one more
+                const auto numSummed = static_cast<float>(numPartitions + 1);
+
+                for (const auto withPartialSum : { false, true })
+                {
+                    for (const auto interleave : { false, true })
+                    {
+                        const auto expected = run(custom_juce::multiplyAccumulateScalar, c, numBins, withPartialSum, interleave);
+                        const auto actual = run(kernel.kernel, c, numBins, withPartialSum, interleave);
+
+                        for (size_t k = 0; k < 2 * numBins; ++k)
+                        {
+                            const auto error = std::abs(actual[k] - expected[k]) / numSummed;
+                            worstError = juce::jmax(worstError, error);
+
+                            // also catches NaN
+                            if (! (error <= maxErrorPerPartition))
+                            {
+                                if (passed)
+                                    std::cout << kernel.name << ": " << numBins << " bins, " << numPartitions << " partitions"
+                                              << (withPartialSum ? ", partial sum" : "") << (interleave ? ", interleaved" : "")
+                                              << " differs at " << k << std::endl;
+
+                                passed = false;
+                            }
+                        }
+
+                        for (size_t k = 2 * numBins; k < actual.size(); ++k)
+                            overrun = overrun || ! juce::exactlyEqual(actual[k], guardValue);
+                    }
+                }
+            }
+        }
+
+        passed = passed && ! overrun;
+
+        std::cout << kernel.name << " | " << worstError
+                  << (worstError <= maxErrorPerPartition ? "" : " | out of tolerance")
+                  << (overrun ? " | wrote past the output" : "") << std::endl;
+    }
+
+    return passed ? 0 : 1;
+}
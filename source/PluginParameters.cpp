@@ -118,11 +118,60 @@ juce::AudioProcessorValueTreeState::ParameterLayout PluginParameters::createPara
                                                                   0));                                                               
     params.push_back(std::make_unique<juce::AudioParameterChoice>(SOFA_CHOICE_ID,
                                                                   SOFA_CHOICE_NAME,
-                                                                  juce::StringArray("measured", "interpolated_sh", "interpolated_sh_timealign", "interpolated_mca"),
+                                                                  juce::StringArray("measured", "interpolated_sh", "interpolated_sh_timealign", "interpolated_mca", "external"),
                                                                   0));
     params.push_back(std::make_unique<juce::AudioParameterBool> (INTERP_ID,
                                                                 INTERP_NAME,
                                                                 defaultInterpParam));
+    params.push_back(std::make_unique<juce::AudioParameterBool> (HRTF_BANK_ID,
+                                                                HRTF_BANK_NAME,
+                                                                defaultHRTFBankParam));
+    params.push_back(std::make_unique<juce::AudioParameterChoice>(INTERP_ENGINE_ID,
+                                                                  INTERP_ENGINE_NAME,
+                                                                  juce::StringArray("Inverse Distance", "Barycentric"),
+                                                                  0));
+    params.push_back(std::make_unique<juce::AudioParameterBool> (MIN_PHASE_ID,
+                                                                MIN_PHASE_NAME,
+                                                                defaultMinPhaseParam));
+    params.push_back(std::make_unique<juce::AudioParameterChoice>(TRUNCATION_ID,
+                                                                  TRUNCATION_NAME,
+                                                                  juce::StringArray("-40 dB", "-50 dB", "-60 dB", "-70 dB", "-80 dB"),
+                                                                  defaultTruncationParam));
+    params.push_back(std::make_unique<juce::AudioParameterChoice>(HRIR_LENGTH_ID,
+                                                                  HRIR_LENGTH_NAME,
+                                                                  juce::StringArray("64", "128", "256", "Full"),
+                                                                  defaultHRIRLengthParam));
+    params.push_back(std::make_unique<juce::AudioParameterFloat>(UPDATE_THRESHOLD_ID,
+                                                                 UPDATE_THRESHOLD_NAME,
+                                                                 updateThresholdRange,
+                                                                 defaultUpdateThresholdParam));
+    params.push_back(std::make_unique<juce::AudioParameterFloat>(TRANSITION_TIME_ID,
+                                                                 TRANSITION_TIME_NAME,
+                                                                 transitionTimeRange,
+                                                                 defaultTransitionTimeParam,
+                                                                 juce::AudioParameterFloatAttributes().withLabel ("ms")));
+    params.push_back(std::make_unique<juce::AudioParameterChoice>(TRANSITION_CURVE_ID,
+                                                                  TRANSITION_CURVE_NAME,
+                                                                  juce::StringArray("Linear", "Equal Power"),
+                                                                  defaultTransitionCurveParam));
+    params.push_back(std::make_unique<juce::AudioParameterBool> (ADAPTIVE_TRANSITION_ID,
+                                                                ADAPTIVE_TRANSITION_NAME,
+                                                                defaultAdaptiveTransitionParam));
+    // rebuilds the convolution engines, so not automatable
+    params.push_back(std::make_unique<juce::AudioParameterChoice>(PROCESSING_MODE_ID,
+                                                                  PROCESSING_MODE_NAME,
+                                                                  juce::StringArray("Zero Latency", "Fixed Latency", "Non-Uniform"),
+                                                                  defaultProcessingModeParam,
+                                                                  juce::AudioParameterChoiceAttributes().withAutomatable (false)));
+    // the latency in fixed latency mode, the head in non-uniform mode
+    params.push_back(std::make_unique<juce::AudioParameterChoice>(PARTITION_SIZE_ID,
+                                                                  PARTITION_SIZE_NAME,
+                                                                  juce::StringArray("64", "128", "256", "512", "1024", "2048", "4096"),
+                                                                  defaultPartitionSizeParam,
+                                                                  juce::AudioParameterChoiceAttributes().withAutomatable (false)));
+    params.push_back(std::make_unique<juce::AudioParameterBool> (MORPHING_ID,
+                                                                MORPHING_NAME,
+                                                                defaultMorphingParam));
                                                                
 
     
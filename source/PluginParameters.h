@@ -31,7 +31,19 @@ public:
             DOPPLER_ID = {"param_doppler", 1},
             DOPPLER_STRENGTH_ID = {"param_doppler_strength", 1},
             SOFA_CHOICE_ID = {"param_sofa_choices", 1},
-            INTERP_ID = {"param_nearest_neighbour_interp", 1};
+            INTERP_ID = {"param_nearest_neighbour_interp", 1},
+            HRTF_BANK_ID = {"param_hrtf_bank", 1},
+            INTERP_ENGINE_ID = {"param_interp_engine", 1},
+            MIN_PHASE_ID = {"param_min_phase", 1},
+            TRUNCATION_ID = {"param_truncation", 1},
+            HRIR_LENGTH_ID = {"param_hrir_length", 1},
+            UPDATE_THRESHOLD_ID = {"param_update_threshold", 1},
+            TRANSITION_TIME_ID = {"param_transition_time", 1},
+            TRANSITION_CURVE_ID = {"param_transition_curve", 1},
+            ADAPTIVE_TRANSITION_ID = {"param_adaptive_transition", 1},
+            PROCESSING_MODE_ID = {"param_processing_mode", 1},
+            PARTITION_SIZE_ID = {"param_partition_size", 1},
+            MORPHING_ID = {"param_morphing", 1};
  
 
             
@@ -61,11 +73,26 @@ public:
             DOPPLER_NAME = "Doppler Effect Enabled",
             DOPPLER_STRENGTH_NAME = "Doppler Effect Strength",
             SOFA_CHOICE_NAME = "Sofa Choices",
-            INTERP_NAME = "Nearest Neighbour Interpolation";
+            INTERP_NAME = "Nearest Neighbour Interpolation",
+            HRTF_BANK_NAME = "Precomputed HRTF Bank",
+            INTERP_ENGINE_NAME = "Interpolation Engine",
+            MIN_PHASE_NAME = "Minimum Phase HRIRs",
+            TRUNCATION_NAME = "HRIR Truncation Threshold",
+            HRIR_LENGTH_NAME = "HRIR Length",
+            UPDATE_THRESHOLD_NAME = "HRIR Update Threshold",
+            TRANSITION_TIME_NAME = "HRIR Transition Time",
+            TRANSITION_CURVE_NAME = "HRIR Transition Curve",
+            ADAPTIVE_TRANSITION_NAME = "Adaptive HRIR Transition",
+            PROCESSING_MODE_NAME = "Processing Mode",
+            PARTITION_SIZE_NAME = "Partition Size",
+            MORPHING_NAME = "HRIR Morphing";
 
             
     
 
+    // not a parameter, stored as a property of the state tree
+    inline static const juce::Identifier SOFA_FILE_PROPERTY { "sofa_file" };
+
     static juce::StringArray getPluginParameterList();
     static juce::AudioProcessorValueTreeState::ParameterLayout createParameterLayout();
 
@@ -91,6 +118,17 @@ public:
     const inline static float defaultZLFOPhaseParam { 0.f };
     const inline static float defaultZLFOOffsetParam { 0.f };
     const inline static bool defaultInterpParam { true };
+    const inline static bool defaultHRTFBankParam { false };
+    const inline static bool defaultMinPhaseParam { false };
+    const inline static int defaultTruncationParam { 2 };
+    const inline static int defaultHRIRLengthParam { 3 };
+    const inline static float defaultUpdateThresholdParam { 0.25f };
+    const inline static float defaultTransitionTimeParam { 100.f };
+    const inline static int defaultTransitionCurveParam { 0 };
+    const inline static bool defaultAdaptiveTransitionParam { false };
+    const inline static int defaultProcessingModeParam { 0 };
+    const inline static int defaultPartitionSizeParam { 3 };
+    const inline static bool defaultMorphingParam { false };
 
     
 
@@ -112,7 +150,11 @@ public:
                                                 zLFODepthRange {0.0f, 100.f, 0.1f},
                                                 zLFOPhaseRange {-180.f, 180.f, 1.f},
                                                 zLFOOffsetRange {-HALF_CUBE_EDGE_LENGTH, HALF_CUBE_EDGE_LENGTH, 0.01f},
-                                                dopplerStrengthRange {0.0, 10.0, 0.01f};
+                                                dopplerStrengthRange {0.0, 10.0, 0.01f},
+                                                // fraction of the spacing of the measurement grid
+                                                updateThresholdRange {0.0f, 1.0f, 0.01f},
+                                                // milliseconds
+                                                transitionTimeRange {5.0f, 200.0f, 1.0f};
 
 
 private:
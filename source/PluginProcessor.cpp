@@ -1,6 +1,7 @@
 #include "PluginProcessor.h"
 #include "PluginEditor.h"
 #include "Constants.h"
+#include "dsp/convolution/custom_juce_FFTBackend.h"
 
 //==============================================================================
 AudioPluginAudioProcessor::AudioPluginAudioProcessor()
@@ -23,6 +24,19 @@ AudioPluginAudioProcessor::AudioPluginAudioProcessor()
 
     sofaChoiceParam = dynamic_cast<juce::AudioParameterChoice*> ( parameters.getParameter( PluginParameters::SOFA_CHOICE_ID.getParamID() ) );
     sofaChoices hrirChoice = static_cast<sofaChoices> ( sofaChoiceParam->getIndex() );
+    hrirLoader.sofaChoice.store(hrirChoice);
+
+    // the source is mono, both ears share one input spectrum in the convolution
+    convolution.setMonoInput(true);
+
+    // the selection follows every position change, one engine fades between the spectra
+    convolution.setCrossfade(custom_juce::Convolution::Crossfade::spectra);
+    updateProcessingMode();
+
+    // fftw (if built with it) only measures its transforms once per machine
+    custom_juce::FFTBackend::setWisdomFile(juce::File::getSpecialLocation(juce::File::userApplicationDataDirectory)
+                                               .getChildFile("Orbe")
+                                               .getChildFile("fftw-wisdom"));
     
     paramAzimuth.store(PluginParameters::defaultAzimParam);
     paramElevation.store(PluginParameters::defaultElevParam);
@@ -51,13 +65,15 @@ AudioPluginAudioProcessor::AudioPluginAudioProcessor()
     yLFO = std::make_unique<juce::dsp::Oscillator<float>>();
     zLFO = std::make_unique<juce::dsp::Oscillator<float>>();
 
-    hrirLoader.newHRIRAvailable = [this] () {
-        hrirAvailable.store(true);
+    hrirLoader.newHRIRSetAvailable = [this] () {
+        hrirSetAvailable.store(true);
     };
 }
 
 AudioPluginAudioProcessor::~AudioPluginAudioProcessor()
 {
+    cancelPendingUpdate();
+
     for (auto & parameterID : PluginParameters::getPluginParameterList()) {
         parameters.removeParameterListener(parameterID, this);
     }
@@ -136,11 +152,26 @@ void AudioPluginAudioProcessor::prepareToPlay (double sampleRate, int samplesPer
                                   (juce::uint32) getTotalNumInputChannels() };
     
     hrirLoader.prepare(processSpec);
+    transitionPolicy.reset();
     
     //currentConvolution.prepare(processSpec);
     //previousConvolution.prepare(processSpec);
     
-    convolution.prepare(processSpec);    
+    // hand the bank to the convolution before prepare, so it is partitioned right away
+    if (hrirSetAvailable.load()) {
+        updateHRIRSet();
+    }
+
+    // single hrirs are copied into these, see updateHRIR()
+    convolution.reserveImpulseResponses((int) processSpec.numChannels, hrirLoader.getIRLength());
+    convolution.prepare(processSpec);
+    // the latency of a fixed mode depends on the block size as well
+    requestedLatency = convolution.getLatency();
+    setLatencySamples(requestedLatency);
+
+    // delays the dry signal while no hrir is loaded, by at most the largest partition size
+    bypassDelay.prepare({ sampleRate, (juce::uint32) samplesPerBlock, 1 });
+    bypassDelay.setMaximumDelayInSamples(juce::nextPowerOfTwo(juce::jmax(samplesPerBlock, 4096)));
     
     int numDelayChannels = 1;
     dsp::ProcessSpec delaySpec{sampleRate,
@@ -205,23 +236,39 @@ void AudioPluginAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer,
     {
         processLFOs();
     }
+    else if (prefetchingTrajectory)
+    {
+        stopTrajectoryPrefetch();
+    }
 
 
     // UPDATE HRIR
 
-    if (hrirAvailable.load()) {
-        updateHRIR();
+    if (hrirSetAvailable.load()) {
+        updateHRIRSet();
     }
 
-    if (hrirRequestDenied) {
-        hrirRequestDenied = false;
-        requestNewHRIR();
+    hrirLoader.settle();
+
+    if (auto* frame = hrirLoader.acquireHRIR()) {
+        // single jobs are only used while no lfo trajectory is prefetched
+        if (! prefetchingTrajectory)
+            updateHRIR(*frame);
+    }
+
+    if (prefetchingTrajectory) {
+        if (auto* frame = hrirLoader.acquirePrefetchedHRIR(lfoBlock))
+            updateHRIR(*frame);
+    }
+
+    if (directBankLookup.load() && hrirBank != nullptr) {
+        updateBarycentricSelection();
     }
+
     // MAKE SIGNAL MONO
 
     buffer.addFrom(0, 0, buffer.getReadPointer(1), buffer.getNumSamples());
-    buffer.applyGain(0.5);
-    buffer.copyFrom(1, 0, buffer.getReadPointer(0), buffer.getNumSamples());
+    buffer.applyGain(0, 0, buffer.getNumSamples(), 0.5);
 
     // APPLY CONVOLUTION
     
@@ -231,7 +278,39 @@ void AudioPluginAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer,
 
     if ( convolutionReady) 
     {
+        // reads the mono signal from the first channel and writes both ears
         convolution.process( context );
+
+        // delays of a bank entry only fit once the convolution processes the set they came from
+        if (pendingDelayGeneration >= 0 && convolution.getImpulseResponseSetGeneration() == pendingDelayGeneration) {
+            delayTimeLeft = pendingDelayLeft;
+            delayTimeRight = pendingDelayRight;
+            pendingDelayGeneration = -1;
+        }
+
+        // the adaptive fade is measured from the last direction the convolution went to
+        if (convolution.getNumTransitions() != numTransitionsStarted) {
+            numTransitionsStarted = convolution.getNumTransitions();
+            transitionPolicy.transitionStarted();
+        }
+    }
+    else
+    {
+        // the host compensates the latency of the convolution, so the dry signal has to be as late
+        if (requestedLatency > 0) {
+            auto monoBlock = block.getSingleChannelBlock(0);
+            bypassDelay.setDelay((float) requestedLatency);
+            bypassDelay.process(juce::dsp::ProcessContextReplacing<float>(monoBlock));
+        }
+
+        buffer.copyFrom(1, 0, buffer.getReadPointer(0), buffer.getNumSamples());
+    }
+
+    // a new processing mode reports its latency once its engine is installed. The
+    // host is told on the message thread, setLatencySamples() isn't for the audio thread
+    if (convolution.getLatency() != requestedLatency) {
+        requestedLatency = convolution.getLatency();
+        triggerAsyncUpdate();
     }
     
     // Apply Distance Compensation
@@ -294,7 +373,10 @@ void AudioPluginAudioProcessor::setStateInformation (const void* data, int sizeI
 
     if (xmlState.get() != nullptr)
         if (xmlState->hasTagName (parameters.state.getType()))
+        {
             parameters.replaceState (juce::ValueTree::fromXml (*xmlState));
+            setExternalSofaFile (getExternalSofaFile());
+        }
 }
 
 void AudioPluginAudioProcessor::parameterChanged(const String &parameterID, float newValue) {
@@ -325,13 +407,82 @@ void AudioPluginAudioProcessor::parameterChanged(const String &parameterID, floa
     // Change hrir if sofa choice parameter changed
     if (parameterID == PluginParameters::SOFA_CHOICE_ID.getParamID() )
     {
-        hrirLoader.sofaChoice = static_cast<sofaChoices> ( sofaChoiceParam->getIndex() );
-        requestNewHRIR();
+        hrirLoader.sofaChoice.store(static_cast<sofaChoices> ( sofaChoiceParam->getIndex() ));
+        reloadHRIRs();
     }
     
     if ( parameterID == PluginParameters::INTERP_ID.getParamID() )
     {
-        hrirLoader.doNearestNeighbourInterpolation = newValue;
+        hrirLoader.doNearestNeighbourInterpolation.store(newValue > 0.5f);
+        updateDirectBankLookup();
+        hrirLoader.invalidateHRIRs();
+    }
+
+    if ( parameterID == PluginParameters::INTERP_ENGINE_ID.getParamID() )
+    {
+        hrirLoader.interpolationEngine.store(static_cast<interpolationEngines> ( static_cast<int> ( newValue ) ));
+        updateDirectBankLookup();
+        hrirLoader.invalidateHRIRs();
+        requestNewHRIR();
+    }
+
+    if ( parameterID == PluginParameters::MIN_PHASE_ID.getParamID()
+        || parameterID == PluginParameters::TRUNCATION_ID.getParamID()
+        || parameterID == PluginParameters::HRIR_LENGTH_ID.getParamID() )
+    {
+        if ( parameterID == PluginParameters::MIN_PHASE_ID.getParamID() )
+            hrirLoader.minimumPhase.store(newValue > 0.5f);
+        else if ( parameterID == PluginParameters::TRUNCATION_ID.getParamID() )
+            hrirLoader.truncationThresholdDb.store(-40.0f - 10.0f * static_cast<float> ( static_cast<int> ( newValue ) ));
+        else // 64, 128, 256 taps or the full length
+            hrirLoader.maxHRIRLength.store(static_cast<int> ( newValue ) < 3 ? 64 << static_cast<int> ( newValue ) : 0);
+
+        // the datasets get processed again, so the bank has to follow
+        reloadHRIRs();
+    }
+
+    if ( parameterID == PluginParameters::UPDATE_THRESHOLD_ID.getParamID() )
+    {
+        hrirLoader.updateThreshold.store(newValue);
+    }
+
+    if ( parameterID == PluginParameters::TRANSITION_TIME_ID.getParamID() )
+    {
+        transitionPolicy.timeMs = newValue;
+    }
+
+    if ( parameterID == PluginParameters::TRANSITION_CURVE_ID.getParamID() )
+    {
+        equalPowerTransition = static_cast<int> ( newValue ) == 1;
+    }
+
+    if ( parameterID == PluginParameters::ADAPTIVE_TRANSITION_ID.getParamID() )
+    {
+        transitionPolicy.adaptive = newValue > 0.5f;
+    }
+
+    if ( parameterID == PluginParameters::MORPHING_ID.getParamID() )
+    {
+        morphing = newValue > 0.5f;
+    }
+
+    if ( parameterID == PluginParameters::PROCESSING_MODE_ID.getParamID() )
+    {
+        processingMode = static_cast<int> ( newValue );
+        updateProcessingMode();
+    }
+
+    if ( parameterID == PluginParameters::PARTITION_SIZE_ID.getParamID() )
+    {
+        partitionSize = 64 << static_cast<int> ( newValue );
+        updateProcessingMode();
+    }
+
+    if ( parameterID == PluginParameters::HRTF_BANK_ID.getParamID() )
+    {
+        hrirLoader.useHRTFBank.store(newValue > 0.5f);
+        updateDirectBankLookup();
+        reloadHRIRs();
     }
     
     parameterListener.parameterChanged(parameterID, newValue);
@@ -357,22 +508,100 @@ float AudioPluginAudioProcessor::getAtomicParameterValue(const String &parameter
 
 }
 
+void AudioPluginAudioProcessor::setExternalSofaFile(const juce::File &file) {
+    parameters.state.setProperty(PluginParameters::SOFA_FILE_PROPERTY, file.getFullPathName(), nullptr);
+    hrirLoader.setExternalSofaFile(file);
+
+    if (hrirLoader.sofaChoice.load() == sofaChoices::external)
+    {
+        reloadHRIRs();
+    }
+}
+
+juce::File AudioPluginAudioProcessor::getExternalSofaFile() const {
+    const auto path = parameters.state.getProperty(PluginParameters::SOFA_FILE_PROPERTY).toString();
+    return path.isNotEmpty() ? juce::File(path) : juce::File();
+}
+
 juce::AudioProcessorValueTreeState &AudioPluginAudioProcessor::getValueTreeState() {
     return parameters;
 }
 
-void AudioPluginAudioProcessor::updateHRIR() {
+void AudioPluginAudioProcessor::updateHRIR(HRIRFrame& frame) {
     // DBG("updateHRIR() wurde aufgerufen.");
 
-    hrirAvailable.store(false);
-    
-    convolution.loadImpulseResponse(std::move(hrirLoader.getCurrentHRIR()), getSampleRate(), custom_juce::Convolution::Stereo::yes, custom_juce::Convolution::Trim::no, custom_juce::Convolution::Normalise::no);
-    hrirLoader.getCurrentDelays(delayTimeLeft, delayTimeRight);
-    
-    hrirLoader.hrirAccessed();
+    if (frame.bankIndex >= 0) {
+        // with barycentric lookups the selection is already made once per block
+        if (! (directBankLookup.load() && hrirBank != nullptr)) {
+            setTransitionFor(frame.azimuth, frame.elevation);
+            convolution.selectImpulseResponse(frame.bankIndex, frame.setGeneration);
+            setBankDelays(frame.leftDelay, frame.rightDelay, frame.setGeneration);
+        }
+    } else {
+        // the convolution copies the hrir into a buffer of its own, the frame keeps its allocation
+        setTransitionFor(frame.azimuth, frame.elevation);
+        convolution.loadImpulseResponseFrom(frame.hrir, getSampleRate(), custom_juce::Convolution::Stereo::yes, custom_juce::Convolution::Trim::no, custom_juce::Convolution::Normalise::no);
+        delayTimeLeft = frame.leftDelay;
+        delayTimeRight = frame.rightDelay;
+        pendingDelayGeneration = -1;
+    }
+
     convolutionReady = true;
 }
 
+void AudioPluginAudioProcessor::setBankDelays(float left, float right, int generation) {
+    pendingDelayLeft = left;
+    pendingDelayRight = right;
+    pendingDelayGeneration = generation;
+}
+
+void AudioPluginAudioProcessor::updateHRIRSet() {
+    hrirSetAvailable.store(false);
+
+    // every measurement of the current sofa choice gets transformed once, afterwards
+    // position changes only select another entry of the bank
+    // like the set, the generation stays put until hrirSetAccessed()
+    hrirBankGeneration = hrirLoader.getCurrentHRIRSetGeneration();
+    convolution.loadImpulseResponseSet(std::move(hrirLoader.getCurrentHRIRSet()), getSampleRate(), hrirBankGeneration);
+    hrirBank = hrirLoader.getCurrentHRIRSetData();
+    bankSelectionValid = false;
+
+    hrirLoader.hrirSetAccessed();
+}
+
+void AudioPluginAudioProcessor::updateBarycentricSelection() {
+    const auto azimuth = paramAzimuth.load();
+    const auto elevation = paramElevation.load();
+
+    if (bankSelectionValid && juce::exactlyEqual(azimuth, lastBankAzimuth) && juce::exactlyEqual(elevation, lastBankElevation))
+        return;
+
+    int indices[3];
+    float weights[3];
+
+    if (! hrirBank->getTriangulation().lookup(azimuth, elevation, indices, weights))
+        return;
+
+    // the three spectra are blended inside the convolution, the delays are blended here.
+    // both only take effect once the convolution has installed the engine of this bank
+    setTransitionFor(azimuth, elevation);
+    convolution.selectImpulseResponses(indices, weights, 3, hrirBankGeneration);
+
+    float left = 0.0f;
+    float right = 0.0f;
+
+    for (int i = 0; i < 3; ++i) {
+        left += weights[i] * hrirBank->getDelay(indices[i], 0);
+        right += weights[i] * hrirBank->getDelay(indices[i], 1);
+    }
+
+    setBankDelays(left, right, hrirBankGeneration);
+
+    lastBankAzimuth = azimuth;
+    lastBankElevation = elevation;
+    bankSelectionValid = true;
+}
+
 //==============================================================================
 // This creates new instances of the plugin..
 juce::AudioProcessor* JUCE_CALLTYPE createPluginFilter()
@@ -389,6 +618,11 @@ void AudioPluginAudioProcessor::processLFOs()
 {
     if (*parameters.getRawParameterValue("param_lfo_start") > 0.5f) 
     {
+        // the lfos run at one sample per block, this is their phase advance per block at 1 Hz
+        const float increment = juce::MathConstants<float>::twoPi * static_cast<float>(getBlockSize() / getSampleRate());
+        LFOTrajectory trajectory;
+        trajectory.block = ++lfoBlock;
+
         // X LFO
         if ((*parameters.getRawParameterValue("param_xlfo_rate") > 0.0f) && (*parameters.getRawParameterValue("param_xlfo_depth") > 0.0f))
         {
@@ -398,12 +632,19 @@ void AudioPluginAudioProcessor::processLFOs()
             float offset = *parameters.getRawParameterValue("param_xlfo_offset");
 
             xLFO->setFrequency(frequency);
-            float xlfoSample = amplitude * std::sin(xLFO->processSample(degreesToRadians(phase))) + offset;
+            float xArgument = xLFO->processSample(degreesToRadians(phase));
+            float xlfoSample = amplitude * std::sin(xArgument) + offset;
+            trajectory.axes[0] = { xArgument, frequency * increment, amplitude, offset, PluginParameters::xRange.start, PluginParameters::xRange.end };
 
             xlfoSample = juce::jlimit(PluginParameters::xRange.start, PluginParameters::xRange.end, xlfoSample);
             float normalizedX = PluginParameters::xRange.convertTo0to1(xlfoSample);
             parameters.getParameter("param_x")->setValueNotifyingHost(normalizedX);
         }
+        else
+        {
+            float x = PluginParameters::xRange.convertFrom0to1(parameters.getParameter("param_x")->getValue());
+            trajectory.axes[0] = { 0.0f, 0.0f, 0.0f, x, PluginParameters::xRange.start, PluginParameters::xRange.end };
+        }
         // Y LFO
         if ((*parameters.getRawParameterValue("param_ylfo_rate") > 0.0f) && (*parameters.getRawParameterValue("param_ylfo_depth") > 0.0f))
         {
@@ -413,12 +654,19 @@ void AudioPluginAudioProcessor::processLFOs()
             float offset = *parameters.getRawParameterValue("param_ylfo_offset");
 
             yLFO->setFrequency(frequency);
-            float ylfoSample = amplitude * std::sin(yLFO->processSample(degreesToRadians(phase))) + offset;
+            float yArgument = yLFO->processSample(degreesToRadians(phase));
+            float ylfoSample = amplitude * std::sin(yArgument) + offset;
+            trajectory.axes[1] = { yArgument, frequency * increment, amplitude, offset, PluginParameters::yRange.start, PluginParameters::yRange.end };
 
             ylfoSample = juce::jlimit(PluginParameters::yRange.start, PluginParameters::yRange.end, ylfoSample);
             float normalizedY = PluginParameters::yRange.convertTo0to1(ylfoSample);
             parameters.getParameter("param_y")->setValueNotifyingHost(normalizedY);
         }
+        else
+        {
+            float y = PluginParameters::yRange.convertFrom0to1(parameters.getParameter("param_y")->getValue());
+            trajectory.axes[1] = { 0.0f, 0.0f, 0.0f, y, PluginParameters::yRange.start, PluginParameters::yRange.end };
+        }
         // Z LFO
         if ((*parameters.getRawParameterValue("param_zlfo_rate") > 0.0f) && (*parameters.getRawParameterValue("param_zlfo_depth") > 0.0f))
         {
@@ -428,15 +676,66 @@ void AudioPluginAudioProcessor::processLFOs()
             float offset = *parameters.getRawParameterValue("param_zlfo_offset");
 
             zLFO->setFrequency(frequency);
-            float zlfoSample = amplitude * std::sin(zLFO->processSample(degreesToRadians(phase))) + offset;
+            float zArgument = zLFO->processSample(degreesToRadians(phase));
+            float zlfoSample = amplitude * std::sin(zArgument) + offset;
+            trajectory.axes[2] = { zArgument, frequency * increment, amplitude, offset, PluginParameters::zRange.start, PluginParameters::zRange.end };
 
             zlfoSample = juce::jlimit(PluginParameters::zRange.start, PluginParameters::zRange.end, zlfoSample);
             float normalizedZ = PluginParameters::zRange.convertTo0to1(zlfoSample);
             parameters.getParameter("param_z")->setValueNotifyingHost(normalizedZ);
         }
+        else
+        {
+            float z = PluginParameters::zRange.convertFrom0to1(parameters.getParameter("param_z")->getValue());
+            trajectory.axes[2] = { 0.0f, 0.0f, 0.0f, z, PluginParameters::zRange.start, PluginParameters::zRange.end };
+        }
+
+        // the positions ahead are known, so their hrirs are computed before they are needed
+        const bool moving = std::any_of(trajectory.axes.begin(), trajectory.axes.end(), [] (const auto& axis) { return axis.amplitude > 0.0f; });
+
+        if (moving)
+        {
+            trajectory.generation = trajectory.continues(lfoTrajectory) ? lfoTrajectory.generation : lfoTrajectory.generation + 1;
+            lfoTrajectory = trajectory;
+            hrirLoader.submitTrajectory(lfoTrajectory);
+            prefetchingTrajectory = true;
+        }
+        else if (prefetchingTrajectory)
+        {
+            stopTrajectoryPrefetch();
+        }
     }
 }
 
+void AudioPluginAudioProcessor::stopTrajectoryPrefetch()
+{
+    // the last position is loaded the usual way
+    hrirLoader.stopTrajectory();
+    prefetchingTrajectory = false;
+    requestNewHRIR();
+}
+
+void AudioPluginAudioProcessor::handleAsyncUpdate()
+{
+    setLatencySamples(convolution.getLatency());
+}
+
+void AudioPluginAudioProcessor::updateProcessingMode()
+{
+    using Convolution = custom_juce::Convolution;
+
+    const int size = partitionSize.load();
+
+    switch (processingMode.load())
+    {
+        case 1:  convolution.setProcessingMode(Convolution::Latency { size }, Convolution::NonUniform { 0 }); break;
+        case 2:  convolution.setProcessingMode(Convolution::Latency { 0 }, Convolution::NonUniform { size }); break;
+        default: convolution.setProcessingMode(Convolution::Latency { 0 }, Convolution::NonUniform { 0 }); break;
+    }
+
+    // the engines are rebuilt in the background, processBlock passes the new latency on
+}
+
 void AudioPluginAudioProcessor::refreshLFOs() 
 {
     xLFO->reset();
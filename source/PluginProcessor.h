@@ -5,9 +5,10 @@
 
 #include "PluginParameters.h"
 #include "dsp/HRIRLoader.h"
+#include "dsp/HRIRTransitionPolicy.h"
 
 //==============================================================================
-class AudioPluginAudioProcessor final : public juce::AudioProcessor, private juce::AudioProcessorValueTreeState::Listener
+class AudioPluginAudioProcessor final : public juce::AudioProcessor, private juce::AudioProcessorValueTreeState::Listener, private juce::AsyncUpdater
 {
 public:
     //==============================================================================
@@ -47,37 +48,84 @@ public:
     void setStateInformation (const void* data, int sizeInBytes) override;
 
     float getAtomicParameterValue(const juce::String& parameterID);
+    // sofa file used by the "external" sofa choice, it is loaded in the background
+    void setExternalSofaFile(const juce::File& file);
+    juce::File getExternalSofaFile() const;
     juce::AudioProcessorValueTreeState& getValueTreeState();
 
     ParameterListener parameterListener;
 
 private:
     void parameterChanged (const juce::String& parameterID, float newValue) override;
-    void updateHRIR();
+    // passes the latency of the convolution on to the host, on the message thread
+    void handleAsyncUpdate() override;
+    void updateHRIR(HRIRFrame& frame);
+    void updateHRIRSet();
+    void setBankDelays(float left, float right, int generation);
+    void updateBarycentricSelection();
+    void updateDirectBankLookup()
+    {
+        directBankLookup = hrirLoader.useHRTFBank.load() && hrirLoader.doNearestNeighbourInterpolation.load() && hrirLoader.interpolationEngine.load() == interpolationEngines::barycentric;
+    }
     void requestNewHRIR()
     {
-        bool success = hrirLoader.submitJob(paramAzimuth.load(), paramElevation.load());
-        hrirRequestDenied = !success;
+        hrirLoader.submitJob(paramAzimuth.load(), paramElevation.load());
+    }
+    // the dataset or its processing changed, everything computed so far is outdated
+    void reloadHRIRs()
+    {
+        hrirLoader.invalidateHRIRs();
+        if (hrirLoader.useHRTFBank.load())
+            hrirLoader.submitSetJob();
+        requestNewHRIR();
     }
     void applyPreset(int presetOption);
     void processLFOs();
     void refreshLFOs();
+    void stopTrajectoryPrefetch();
+    void updateProcessingMode();
+    // sets the crossfade of the convolution for a change to the given direction
+    void setTransitionFor(float azimuth, float elevation)
+    {
+        // morphing interpolates within the block instead, for sources that move all the time
+        convolution.setCrossfade(morphing.load() ? custom_juce::Convolution::Crossfade::morph
+                                                 : custom_juce::Convolution::Crossfade::spectra);
+        convolution.setTransition(transitionPolicy.getTransitionTime(azimuth, elevation),
+                                  equalPowerTransition.load() ? custom_juce::Convolution::TransitionCurve::equalPower
+                                                              : custom_juce::Convolution::TransitionCurve::linear);
+    }
 
 private:
     juce::AudioProcessorValueTreeState parameters;
 
     HRIRLoader hrirLoader;
+    HRIRTransitionPolicy transitionPolicy;
+    int numTransitionsStarted = 0;
+    std::atomic<bool> equalPowerTransition { false };
+    std::atomic<bool> morphing { PluginParameters::defaultMorphingParam };
+    std::atomic<int> processingMode { PluginParameters::defaultProcessingModeParam };
+    std::atomic<int> partitionSize { 64 << PluginParameters::defaultPartitionSizeParam };
     
     juce::AudioParameterChoice* sofaChoiceParam;
     juce::AudioParameterBool* interpParam;
 
-    bool hrirRequestDenied = false;
-    std::atomic<bool> hrirAvailable { false };
+    std::atomic<bool> hrirSetAvailable { false };
+    // barycentric weights are looked up on the audio thread, once per block
+    std::atomic<bool> directBankLookup { false };
+    std::shared_ptr<const HRIRSet> hrirBank;
+    int hrirBankGeneration = 0;
+    float lastBankAzimuth = 0.0f;
+    float lastBankElevation = 0.0f;
+    bool bankSelectionValid = false;
     bool convolutionReady = false;
 
     std::unique_ptr<juce::dsp::Oscillator<float>> xLFO;
     std::unique_ptr<juce::dsp::Oscillator<float>> yLFO;
     std::unique_ptr<juce::dsp::Oscillator<float>> zLFO;
+    // trajectory of the running lfos, counted in blocks
+    LFOTrajectory lfoTrajectory;
+    juce::int64 lfoBlock = 0;
+    bool prefetchingTrajectory = false;
 
     std::atomic<float> paramAzimuth { 0.0f };
     std::atomic<float> paramElevation { 0.0f };
@@ -85,13 +133,22 @@ private:
 
     std::atomic<bool> paramDoppler {false};
 
-    custom_juce::Convolution convolution;
+    // one background thread builds the convolution engines of all instances
+    juce::SharedResourcePointer<custom_juce::ConvolutionMessageQueue> convolutionQueue;
+    custom_juce::Convolution convolution { *convolutionQueue };
     
     juce::dsp::DelayLine<float, juce::dsp::DelayLineInterpolationTypes::Lagrange3rd> delayLineLeft;
     juce::dsp::DelayLine<float, juce::dsp::DelayLineInterpolationTypes::Lagrange3rd> delayLineRight;
+    juce::dsp::DelayLine<float, juce::dsp::DelayLineInterpolationTypes::None> bypassDelay;
 
     float delayTimeLeft = 0;
     float delayTimeRight = 0;
+    // latency the audio thread last asked the message thread to report
+    int requestedLatency = 0;
+    // delays of a bank selection, applied once its set is installed
+    float pendingDelayLeft = 0;
+    float pendingDelayRight = 0;
+    int pendingDelayGeneration = -1;
     
     juce::SmoothedValue<float> smoothDelayLeft { 0.0f };
     juce::SmoothedValue<float> smoothDelayRight { 0.0f };
@@ -0,0 +1,28 @@
+#include "HRIRFrameBuffer.h"
+
+void HRIRFrameBuffer::prepare(int numChannels, int maxLength) {
+    for (auto& frame : frames)
+    {
+        frame.hrir.setSize(numChannels, maxLength);
+        frame.bankIndex = -1;
+        frame.setGeneration = 0;
+        frame.leftDelay = 0.0f;
+        frame.rightDelay = 0.0f;
+    }
+
+    writeIndex = 0;
+    readIndex = 1;
+    middle.store(2);
+}
+
+void HRIRFrameBuffer::publish() {
+    writeIndex = middle.exchange(writeIndex | freshBit) & indexMask;
+}
+
+HRIRFrame* HRIRFrameBuffer::acquire() {
+    if ((middle.load() & freshBit) == 0)
+        return nullptr;
+
+    readIndex = middle.exchange(readIndex) & indexMask;
+    return &frames[static_cast<size_t>(readIndex)];
+}
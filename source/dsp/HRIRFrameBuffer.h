@@ -0,0 +1,47 @@
+#ifndef BINAURALPANNER_HRIRFRAMEBUFFER_H
+#define BINAURALPANNER_HRIRFRAMEBUFFER_H
+
+#include <JuceHeader.h>
+
+// Result of one hrir job: either an entry of the precomputed hrtf bank, or a
+// stereo hrir, plus the delays and the direction that go with it.
+struct HRIRFrame
+{
+    juce::AudioBuffer<float> hrir;
+    int bankIndex = -1;
+    // generation of the bank the index belongs to, see HRIRLoader::getCurrentHRIRSetGeneration
+    int setGeneration = 0;
+    float leftDelay = 0.0f;
+    float rightDelay = 0.0f;
+    float azimuth = 0.0f;
+    float elevation = 0.0f;
+};
+
+// Lock-free triple buffer of HRIRFrames between one writer (the loader thread)
+// and one reader (the audio thread). The writer always has a free frame to fill,
+// the reader always gets the newest published one, older ones are overwritten.
+class HRIRFrameBuffer {
+public:
+    // preallocates every frame, neither thread may use the buffer meanwhile
+    void prepare(int numChannels, int maxLength);
+
+    // writer side
+    HRIRFrame& getWriteFrame() { return frames[static_cast<size_t>(writeIndex)]; }
+    void publish();
+
+    // reader side, returns nullptr if nothing was published since the last call.
+    // The frame stays valid until the next call.
+    HRIRFrame* acquire();
+
+private:
+    static constexpr int freshBit = 4;
+    static constexpr int indexMask = 3;
+
+    std::array<HRIRFrame, 3> frames;
+    int writeIndex = 0;
+    int readIndex = 1;
+    // index of the frame in the middle, plus freshBit if it hasn't been read yet
+    std::atomic<int> middle { 2 };
+};
+
+#endif //BINAURALPANNER_HRIRFRAMEBUFFER_H
@@ -1,72 +1,301 @@
 #include "HRIRLoader.h"
 
-HRIRLoader::HRIRLoader() : juce::Thread("HRIRLoader") {
+HRIRLoader::HRIRLoader() {
 }
 
 HRIRLoader::~HRIRLoader() {
-    stopThread(10);
+    workers->removeClient(*this);
 }
 
 void HRIRLoader::prepare(const juce::dsp::ProcessSpec spec) 
 {
-    stopThread(10);
+    workers->removeClient(*this);
 
-    sofaReader.prepare(spec.sampleRate);
+    const auto settings = loadDatasetSettings();
+    updateProcessing();
+    updateExternalFile();
+    sofaReader.prepare(spec.sampleRate, settings.sofaChoice);
     currentSpec = spec;
+    forceNextJob.store(true);
+    preparedIRLength = sofaReader.get_ir_length(settings.sofaChoice);
+    hrirFrames.prepare(static_cast<int>(spec.numChannels), preparedIRLength);
+    prefetchRing.prepare(static_cast<int>(spec.numChannels), preparedIRLength);
 
-    startThread(juce::Thread::Priority::high);
-}
-
-void HRIRLoader::run() {
-    while (!threadShouldExit()) {
-        if (jobSubmitted.load()) {
-            jobSubmitted.store(false);
-            
-            // set previous hrir to last temp hrir
-            //previousHrirBuffer.makeCopyOf(tempHrirBuffer);
-            
-            // get current hrir
-            currentHrirBuffer.setSize(currentSpec.numChannels, sofaReader.get_ir_length( sofaChoice ));
-            sofaReader.get_hrirs( currentHrirBuffer, requestedHRIR.azm, requestedHRIR.elev, 1, currentLeftDelay, currentRightDelay, sofaChoice, doNearestNeighbourInterpolation );
-            
-            // copy current hrir to temp hrir
-            //tempHrirBuffer.makeCopyOf(currentHrirBuffer);
-
-            newHRIRAvailable();
-        } else {
-            sleep(10);
-        }
+    const auto blocksPerMs = spec.sampleRate / (1000.0 * static_cast<double>(juce::jmax(1u, spec.maximumBlockSize)));
+    prefetchStrideBlocks = juce::jmax(static_cast<juce::int64>(1), static_cast<juce::int64>(std::round(prefetchIntervalMs * blocksPerMs)));
+    prefetchLeadBlocks = static_cast<juce::int64>(std::round(prefetchLeadMs * blocksPerMs));
+    prefetchGeneration = 0;
+    acquiredGeneration = 0;
+
+    // the bank depends on the samplerate, so it is rebuilt right away
+    if (settings.useHRTFBank) {
+        setJobSubmitted.store(false);
+        hrirSetFinished.store(false);
+        if (loadHRIRSet(settings.sofaChoice))
+            newHRIRSetAvailable();
+        else
+            hrirSetFinished.store(true);
+    } else {
+        currentSetDelays.clear();
     }
+
+    workers->addClient(*this);
 }
 
-void HRIRLoader::getCurrentDelays(float &left, float &right){
-    left = currentLeftDelay;
-    right = currentRightDelay;
+HRIRLoader::DatasetSettings HRIRLoader::loadDatasetSettings() const {
+    return { sofaChoice.load(), doNearestNeighbourInterpolation.load(), interpolationEngine.load(), useHRTFBank.load() };
 }
 
-bool HRIRLoader::submitJob(float azm, float elev) {
-    if (hrirFinished.load()) {
-        hrirFinished.store(false);
+bool HRIRLoader::runNextJob() {
+    // a parameter change during the job takes effect with the next one
+    const auto settings = loadDatasetSettings();
+    updateProcessing();
+    updateExternalFile();
 
-        requestedHRIR.azm = azm;
-        requestedHRIR.elev = elev;
+    if (setJobSubmitted.load() && hrirSetFinished.load()) {
+        setJobSubmitted.store(false);
+        hrirSetFinished.store(false);
 
-        jobSubmitted.store(true);
+        // keep the current set if the dataset could not be opened
+        if (loadHRIRSet(settings.sofaChoice))
+            newHRIRSetAvailable();
+        else
+            hrirSetFinished.store(true);
 
         return true;
-    } else {
+    }
+
+    if (jobSubmitted.exchange(false)) {
+        // the trajectory already covers the positions the lfos move to
+        if (trajectoryActive.load())
+            return true;
+
+        // requests coalesce, only the newest target is computed
+        float azm, elev;
+        requestedHRIR.getDirection(azm, elev);
+
+        updatePolicy.threshold = updateThreshold.load();
+        const auto force = forceNextJob.exchange(false);
+
+        // after prepare or a dataset change the loaded direction says nothing about the new filters
+        if (force)
+            updatePolicy.reset();
+
+        // small steps don't rebuild the convolution, settle() catches up on them
+        if (! updatePolicy.shouldUpdate(azm, elev, requestedHRIR.timeMs, sofaReader.get_grid_spacing( settings.sofaChoice )) && ! force) {
+            settlePending.store(true);
+            return true;
+        }
+
+        // if the dataset could not be opened the current hrir is kept
+        if (fillFrame(hrirFrames.getWriteFrame(), azm, elev, settings)) {
+            hrirFrames.publish();
+            updatePolicy.loaded(azm, elev);
+        }
+
+        return true;
+    }
+
+    // one more filter along the trajectory, until the ring is full
+    if (prefetchNext(settings))
+        return true;
+
+    // the worker moves on until a job is submitted or a prefetched filter was used up
+    sofaReader.release_unused(settings.sofaChoice, datasetTimeoutMs);
+    return false;
+}
+
+bool HRIRLoader::fillFrame(HRIRFrame& frame, float azm, float elev, const DatasetSettings& settings) {
+    frame.azimuth = azm;
+    frame.elevation = elev;
+
+    if (settings.useHRTFBank && currentSetChoice == settings.sofaChoice && !currentSetDelays.empty()) {
+        // only look up the nearest measurement, its spectrum is already in the bank
+        frame.bankIndex = sofaReader.get_nearest_measurement( azm, elev, 1, settings.sofaChoice );
+        frame.setGeneration = currentSetGeneration;
+        frame.leftDelay = currentSetDelays[static_cast<size_t>(2 * frame.bankIndex)];
+        frame.rightDelay = currentSetDelays[static_cast<size_t>(2 * frame.bankIndex + 1)];
+        return true;
+    }
+
+    const auto irLength = sofaReader.get_ir_length( settings.sofaChoice );
+    if (irLength == 0)
         return false;
+
+    // keeps the allocation, unless the dataset has longer hrirs than the one in prepare
+    frame.bankIndex = -1;
+    frame.hrir.setSize(static_cast<int>(currentSpec.numChannels), irLength, false, false, true);
+    sofaReader.get_hrirs( frame.hrir, azm, elev, 1, frame.leftDelay, frame.rightDelay, settings.sofaChoice, settings.doNearestNeighbourInterpolation, settings.interpolationEngine );
+    return true;
+}
+
+bool HRIRLoader::prefetchNext(const DatasetSettings& settings) {
+    if (! trajectoryActive.load())
+        return false;
+
+    const auto slot = prefetchRing.findFreeSlot();
+    if (slot < 0)
+        return false;
+
+    LFOTrajectory trajectory;
+    {
+        const juce::SpinLock::ScopedLockType lock(trajectoryLock);
+        trajectory = requestedTrajectory;
     }
+
+    const auto epoch = prefetchEpoch.load();
+    if (trajectory.generation != prefetchGeneration || epoch != prefetchedEpoch) {
+        prefetchGeneration = trajectory.generation;
+        prefetchedEpoch = epoch;
+        nextPrefetchBlock = trajectory.block;
+    }
+
+    // filters that would already be late are skipped
+    nextPrefetchBlock = juce::jmax(nextPrefetchBlock, trajectory.block);
+
+    float azm, elev;
+    trajectory.getDirection(nextPrefetchBlock, azm, elev);
+
+    if (! fillFrame(prefetchRing.getFrame(slot), azm, elev, settings))
+        return false;
+
+    prefetchRing.publish(slot, nextPrefetchBlock, prefetchGeneration, prefetchedEpoch);
+    nextPrefetchBlock += prefetchStrideBlocks;
+    return true;
 }
 
-juce::AudioBuffer<float> &HRIRLoader::getCurrentHRIR() {
-    return currentHrirBuffer;
+void HRIRLoader::submitTrajectory(const LFOTrajectory& trajectory) {
+    const auto restarted = ! trajectoryActive.load() || trajectory.generation != acquiredGeneration;
+
+    {
+        // the audio thread never blocks, the loader picks up the next block's trajectory instead
+        const juce::SpinLock::ScopedTryLockType lock(trajectoryLock);
+        if (! lock.isLocked())
+            return;
+
+        requestedTrajectory = trajectory;
+    }
+
+    acquiredGeneration = trajectory.generation;
+    trajectoryActive.store(true);
+
+    if (restarted)
+        notify();
+}
+
+void HRIRLoader::stopTrajectory() {
+    // the loaded hrir belongs to the trajectory, not to the last single job
+    forceNextJob.store(true);
+    trajectoryActive.store(false);
+}
+
+void HRIRLoader::invalidateHRIRs() {
+    forceNextJob.store(true);
+    prefetchEpoch.fetch_add(1);
+    notify();
+}
+
+void HRIRLoader::settle() {
+    if (! settlePending.load() || juce::Time::getMillisecondCounterHiRes() - requestedHRIR.timeMs.load() < settleTimeMs)
+        return;
+
+    settlePending.store(false);
+    forceNextJob.store(true);
+    jobSubmitted.store(true);
+    notify();
+}
+
+HRIRFrame* HRIRLoader::acquirePrefetchedHRIR(juce::int64 block) {
+    bool releasedSlots = false;
+    auto* frame = prefetchRing.acquire(block + prefetchLeadBlocks, acquiredGeneration, prefetchEpoch.load(), releasedSlots);
+
+    // room for the next filters along the trajectory
+    if (releasedSlots)
+        notify();
+
+    return frame;
+}
+
+void HRIRLoader::updateProcessing() {
+    HRIRProcessing processing;
+    processing.minimumPhase = minimumPhase.load();
+    processing.truncationThresholdDb = truncationThresholdDb.load();
+    processing.maxLength = maxHRIRLength.load();
+
+    sofaReader.set_processing(processing);
+}
+
+void HRIRLoader::setExternalSofaFile(const juce::File& file) {
+    const juce::SpinLock::ScopedLockType lock(externalFileLock);
+    externalFile = file;
+    externalFileChanged.store(true);
+    notify();
+}
+
+void HRIRLoader::updateExternalFile() {
+    if (! externalFileChanged.exchange(false))
+        return;
+
+    juce::File file;
+    {
+        const juce::SpinLock::ScopedLockType lock(externalFileLock);
+        file = externalFile;
+    }
+
+    sofaReader.set_external_file(file);
+}
+
+void HRIRLoader::submitJob(float azm, float elev) {
+    // overwrites a request that hasn't been picked up yet, the newest target wins
+    requestedHRIR.setDirection(azm, elev);
+    requestedHRIR.timeMs = juce::Time::getMillisecondCounterHiRes();
+
+    jobSubmitted.store(true);
+    notify();
+}
+
+void HRIRLoader::submitSetJob() {
+    setJobSubmitted.store(true);
+    notify();
+}
+
+bool HRIRLoader::loadHRIRSet(sofaChoices choice) {
+    if (sofaReader.get_num_measurements( choice ) == 0)
+        return false;
+
+    currentSetChoice = choice;
+    sofaReader.get_measurement_hrirs( currentHrirSetBuffer, currentSetDelays, currentSetChoice );
+
+    previousSetData = std::move(currentSetData);
+    currentSetData = sofaReader.get_shared_hrir_set( currentSetChoice );
+    // bank indices of the frames computed from now on refer to this set
+    ++currentSetGeneration;
+    return true;
+}
+
+HRIRFrame* HRIRLoader::acquireHRIR() {
+    return hrirFrames.acquire();
+}
+
+juce::AudioBuffer<float> &HRIRLoader::getCurrentHRIRSet() {
+    return currentHrirSetBuffer;
+}
+
+std::shared_ptr<const HRIRSet> HRIRLoader::getCurrentHRIRSetData() {
+    return currentSetData;
+}
+
+int HRIRLoader::getCurrentHRIRSetGeneration() const {
+    return currentSetGeneration;
 }
 
 /*juce::AudioBuffer<float> &HRIRLoader::getPreviousHRIR() {
     return previousHrirBuffer;
 }*/
 
-void HRIRLoader::hrirAccessed() {
-    hrirFinished.store(true);
+void HRIRLoader::hrirSetAccessed() {
+    hrirSetFinished.store(true);
+
+    if (setJobSubmitted.load())
+        notify();
 }
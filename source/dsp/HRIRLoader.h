@@ -3,46 +3,165 @@
 
 #include <JuceHeader.h>
 #include "SofaReader.h"
+#include "HRIRFrameBuffer.h"
+#include "HRIRPrefetch.h"
+#include "HRIRWorkerPool.h"
+#include "HRIRUpdatePolicy.h"
 
 struct HRIRJob {
-    std::atomic<float> azm;
-    std::atomic<float> elev;
+    // both angles in one atomic, so the worker never pairs the azimuth of one
+    // request with the elevation of another
+    void setDirection(float azm, float elev) {
+        std::uint32_t bits[2];
+        std::memcpy(&bits[0], &azm, sizeof(float));
+        std::memcpy(&bits[1], &elev, sizeof(float));
+        direction.store((static_cast<std::uint64_t>(bits[0]) << 32) | bits[1]);
+    }
+
+    void getDirection(float& azm, float& elev) const {
+        const auto packed = direction.load();
+        const auto azmBits = static_cast<std::uint32_t>(packed >> 32);
+        const auto elevBits = static_cast<std::uint32_t>(packed);
+        std::memcpy(&azm, &azmBits, sizeof(float));
+        std::memcpy(&elev, &elevBits, sizeof(float));
+    }
+
+    std::atomic<std::uint64_t> direction { 0 };
+    std::atomic<double> timeMs { 0.0 };
 };
 
-class HRIRLoader : public juce::Thread {
+// Computes hrirs in the background. The work runs on the worker pool shared by all
+// instances, jobs of one loader never run concurrently.
+class HRIRLoader : private HRIRWorkerPool::Client {
 public:
     HRIRLoader();
     ~HRIRLoader();
 
     void prepare(const juce::dsp::ProcessSpec spec);
-    bool submitJob(float azm, float elev);
+    // never rejects, a request replaces the one that is still pending
+    void submitJob(float azm, float elev);
+    void submitSetJob();
+    // may be called from any thread, the file is opened in the background
+    void setExternalSofaFile(const juce::File& file);
+
+    void hrirSetAccessed ();
 
-    void hrirAccessed ();
+    // audio thread only. While a trajectory is set, filters along it are computed
+    // ahead of time and single jobs are skipped.
+    void submitTrajectory(const LFOTrajectory& trajectory);
+    void stopTrajectory();
+    // everything computed before is outdated, e.g. after a dataset change. Prefetched
+    // filters get dropped and the next job is loaded even if the direction is the same.
+    void invalidateHRIRs();
+    // audio thread, once per block. Loads the exact target once the direction has
+    // stopped changing, if a change was skipped by the update policy.
+    void settle();
 
-    juce::AudioBuffer<float>& getCurrentHRIR();
-    void getCurrentDelays(float &left, float &right);
+    // audio thread only, newest finished hrir or nullptr if there is none since the
+    // last call. The frame stays valid until the next call.
+    HRIRFrame* acquireHRIR();
+    // audio thread only, newest prefetched hrir that is due at block, filters are
+    // handed out a little early to make up for the time the convolution needs to
+    // build its engine
+    HRIRFrame* acquirePrefetchedHRIR(juce::int64 block);
+    // all measurements of the current sofa choice, 2 channels per measurement
+    juce::AudioBuffer<float>& getCurrentHRIRSet();
+    // dataset the current set was built from, with its triangulation and delays
+    std::shared_ptr<const HRIRSet> getCurrentHRIRSetData();
+    // counts the sets, frames carry the generation their bank index belongs to
+    int getCurrentHRIRSetGeneration() const;
+    // length of the hrirs of the dataset that was current in prepare
+    int getIRLength() const { return preparedIRLength; }
     //juce::AudioBuffer<float>& getPreviousHRIR();
 
     // TODO replace with Listener
-    std::function<void()> newHRIRAvailable;
+    std::function<void()> newHRIRSetAvailable;
     
-    sofaChoices sofaChoice;
-    bool doNearestNeighbourInterpolation = true;
+    // written by the parameters, a job reads them once when it starts
+    std::atomic<sofaChoices> sofaChoice {sofaChoices::measured};
+    std::atomic<bool> doNearestNeighbourInterpolation {true};
+    std::atomic<interpolationEngines> interpolationEngine {interpolationEngines::inverse_distance};
+    // select measurements from a precomputed hrtf bank instead of loading single hrirs
+    std::atomic<bool> useHRTFBank {false};
+    // minimum phase filters truncated to this threshold, the itd stays in the delays.
+    // Written by the parameters, read by the worker on every job.
+    std::atomic<bool> minimumPhase {false};
+    std::atomic<float> truncationThresholdDb {-60.0f};
+    // fixed hrir length in samples, 0 keeps the full length
+    std::atomic<int> maxHRIRLength {0};
+    // direction changes below this fraction of the grid spacing don't load a new hrir
+    std::atomic<float> updateThreshold {0.25f};
 
 private:
-    void run() override;
+    // the dataset settings one job works with
+    struct DatasetSettings {
+        sofaChoices sofaChoice;
+        bool doNearestNeighbourInterpolation;
+        interpolationEngines interpolationEngine;
+        bool useHRTFBank;
+    };
+
+    bool runNextJob() override;
+    void notify() { workers->notify(*this); }
+    DatasetSettings loadDatasetSettings() const;
+    bool loadHRIRSet(sofaChoices choice);
+    bool fillFrame(HRIRFrame& frame, float azm, float elev, const DatasetSettings& settings);
+    bool prefetchNext(const DatasetSettings& settings);
+    void updateProcessing();
+    void updateExternalFile();
 
 private:
+    // datasets that were not used for this long get closed again
+    static constexpr juce::uint32 datasetTimeoutMs = 30000;
+    // spacing of the prefetched filters along a trajectory, and how early they are used
+    static constexpr double prefetchIntervalMs = 10.0;
+    static constexpr double prefetchLeadMs = 20.0;
+    // a skipped direction is loaded once no request came in for this long
+    static constexpr double settleTimeMs = 50.0;
+
+    juce::SharedResourcePointer<HRIRWorkerPool> workers;
+
     std::atomic<bool> jobSubmitted {false};
-    std::atomic<bool> hrirFinished {true};
+    std::atomic<bool> setJobSubmitted {false};
+    std::atomic<bool> hrirSetFinished {true};
 
     SofaReader sofaReader;
+
+    juce::SpinLock externalFileLock;
+    juce::File externalFile;
+    std::atomic<bool> externalFileChanged {false};
     juce::dsp::ProcessSpec currentSpec;
+    int preparedIRLength = 0;
     HRIRJob requestedHRIR;
+
+    HRIRUpdatePolicy updatePolicy;
+    std::atomic<bool> forceNextJob {true};
+    std::atomic<bool> settlePending {false};
     
-    juce::AudioBuffer<float> currentHrirBuffer;
-    float currentLeftDelay;
-    float currentRightDelay;
+    // the loader always has a free frame to write into, it never waits for the audio thread
+    HRIRFrameBuffer hrirFrames;
+
+    HRIRPrefetchRing prefetchRing;
+    juce::SpinLock trajectoryLock;
+    LFOTrajectory requestedTrajectory;
+    std::atomic<bool> trajectoryActive {false};
+    std::atomic<juce::uint32> prefetchEpoch {0};
+    // audio thread side
+    juce::uint32 acquiredGeneration = 0;
+    juce::int64 prefetchLeadBlocks = 0;
+    // worker side
+    juce::uint32 prefetchGeneration = 0;
+    juce::uint32 prefetchedEpoch = 0;
+    juce::int64 nextPrefetchBlock = 0;
+    juce::int64 prefetchStrideBlocks = 1;
+
+    juce::AudioBuffer<float> currentHrirSetBuffer;
+    std::vector<float> currentSetDelays;
+    sofaChoices currentSetChoice = sofaChoices::measured;
+    int currentSetGeneration = 0;
+    // the previous dataset stays referenced until the next set is built, so the
+    // audio thread never drops the last reference
+    std::shared_ptr<const HRIRSet> currentSetData, previousSetData;
     //juce::AudioBuffer<float> previousHrirBuffer;
     //juce::AudioBuffer<float> tempHrirBuffer;
 
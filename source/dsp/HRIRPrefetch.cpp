@@ -0,0 +1,116 @@
+#include "HRIRPrefetch.h"
+
+float LFOTrajectory::getCoordinate(size_t axis, juce::int64 atBlock) const {
+    const auto& a = axes[axis];
+    const auto argument = static_cast<double>(a.argument) + static_cast<double>(atBlock - block) * static_cast<double>(a.increment);
+
+    return juce::jlimit(a.minimum, a.maximum, a.amplitude * static_cast<float>(std::sin(argument)) + a.offset);
+}
+
+void LFOTrajectory::getDirection(juce::int64 atBlock, float& azimuth, float& elevation) const {
+    const auto x = getCoordinate(0, atBlock);
+    const auto y = getCoordinate(1, atBlock);
+    const auto z = getCoordinate(2, atBlock);
+    const auto radius = std::sqrt(x * x + y * y + z * z);
+
+    // same conversion as the parameter listener
+    elevation = juce::approximatelyEqual(radius, 0.0f) ? 0.0f
+              : juce::radiansToDegrees(juce::MathConstants<float>::halfPi - std::acos(z / radius));
+    azimuth = juce::approximatelyEqual(x, 0.0f) && juce::approximatelyEqual(y, 0.0f) ? 0.0f
+            : juce::radiansToDegrees(std::atan2(y, x));
+}
+
+bool LFOTrajectory::continues(const LFOTrajectory& previous) const {
+    // coordinates are a few metres, a millimetre of drift is still the same path
+    constexpr float tolerance = 1.0e-3f;
+
+    for (size_t i = 0; i < axes.size(); ++i)
+    {
+        const auto& a = axes[i];
+        const auto& b = previous.axes[i];
+
+        if (! juce::approximatelyEqual(a.increment, b.increment)
+            || ! juce::approximatelyEqual(a.amplitude, b.amplitude)
+            || ! juce::approximatelyEqual(a.offset, b.offset)
+            || ! juce::approximatelyEqual(a.minimum, b.minimum)
+            || ! juce::approximatelyEqual(a.maximum, b.maximum))
+            return false;
+
+        if (std::abs(getCoordinate(i, block) - previous.getCoordinate(i, block)) > tolerance)
+            return false;
+    }
+
+    return true;
+}
+
+void HRIRPrefetchRing::prepare(int numChannels, int maxLength) {
+    for (auto& slot : slots)
+    {
+        slot.frame.hrir.setSize(numChannels, maxLength);
+        slot.frame.bankIndex = -1;
+        slot.frame.setGeneration = 0;
+        slot.ready.store(false);
+    }
+
+    acquiredSlot = -1;
+}
+
+int HRIRPrefetchRing::findFreeSlot() const {
+    for (int i = 0; i < capacity; ++i)
+        if (! slots[static_cast<size_t>(i)].ready.load())
+            return i;
+
+    return -1;
+}
+
+void HRIRPrefetchRing::publish(int slot, juce::int64 block, juce::uint32 generation, juce::uint32 epoch) {
+    auto& s = slots[static_cast<size_t>(slot)];
+    s.block = block;
+    s.generation = generation;
+    s.epoch = epoch;
+    s.ready.store(true);
+}
+
+HRIRFrame* HRIRPrefetchRing::acquire(juce::int64 block, juce::uint32 generation, juce::uint32 epoch, bool& releasedSlots) {
+    releasedSlots = false;
+
+    if (acquiredSlot >= 0)
+    {
+        slots[static_cast<size_t>(acquiredSlot)].ready.store(false);
+        acquiredSlot = -1;
+        releasedSlots = true;
+    }
+
+    for (int i = 0; i < capacity; ++i)
+    {
+        auto& s = slots[static_cast<size_t>(i)];
+
+        if (! s.ready.load())
+            continue;
+
+        if (s.generation != generation || s.epoch != epoch)
+        {
+            s.ready.store(false);
+            releasedSlots = true;
+            continue;
+        }
+
+        if (s.block > block)
+            continue;
+
+        // only the newest due frame is used, the ones it overtakes are dropped
+        if (acquiredSlot >= 0)
+        {
+            auto& overtaken = slots[static_cast<size_t>(acquiredSlot)].block > s.block ? s : slots[static_cast<size_t>(acquiredSlot)];
+            overtaken.ready.store(false);
+            releasedSlots = true;
+
+            if (&overtaken == &s)
+                continue;
+        }
+
+        acquiredSlot = i;
+    }
+
+    return acquiredSlot >= 0 ? &slots[static_cast<size_t>(acquiredSlot)].frame : nullptr;
+}
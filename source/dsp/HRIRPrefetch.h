@@ -0,0 +1,69 @@
+#ifndef BINAURALPANNER_HRIRPREFETCH_H
+#define BINAURALPANNER_HRIRPREFETCH_H
+
+#include <JuceHeader.h>
+#include "HRIRFrameBuffer.h"
+
+// Sine trajectory of the three position lfos, anchored at the block it was taken
+// at. The lfos advance once per block, so the position at any later block is known.
+struct LFOTrajectory
+{
+    struct Axis
+    {
+        // argument of the sine at the anchor block and its advance per block, an
+        // axis without lfo has no amplitude and sits at its offset
+        float argument = 0.0f;
+        float increment = 0.0f;
+        float amplitude = 0.0f;
+        float offset = 0.0f;
+        float minimum = 0.0f;
+        float maximum = 0.0f;
+    };
+
+    std::array<Axis, 3> axes;
+    juce::int64 block = 0;
+    // changes whenever the trajectory doesn't continue the previous one
+    juce::uint32 generation = 0;
+
+    float getCoordinate(size_t axis, juce::int64 atBlock) const;
+    // in degrees, like the azimuth and elevation parameters
+    void getDirection(juce::int64 atBlock, float& azimuth, float& elevation) const;
+    // true if this is the previous trajectory, only further along
+    bool continues(const LFOTrajectory& previous) const;
+};
+
+// Small ring of hrirs computed ahead of time, each one tagged with the block it
+// belongs to. Single writer (the loader thread), single reader (the audio thread),
+// a slot belongs to the reader while it is marked ready.
+class HRIRPrefetchRing {
+public:
+    static constexpr int capacity = 8;
+
+    // preallocates every frame, neither thread may use the ring meanwhile
+    void prepare(int numChannels, int maxLength);
+
+    // writer side, -1 if all slots are taken
+    int findFreeSlot() const;
+    HRIRFrame& getFrame(int slot) { return slots[static_cast<size_t>(slot)].frame; }
+    void publish(int slot, juce::int64 block, juce::uint32 generation, juce::uint32 epoch);
+
+    // reader side, newest frame that is due at block, or nullptr. Frames that are
+    // overtaken or belong to another generation or epoch are released, the returned
+    // one is released on the next call.
+    HRIRFrame* acquire(juce::int64 block, juce::uint32 generation, juce::uint32 epoch, bool& releasedSlots);
+
+private:
+    struct Slot
+    {
+        HRIRFrame frame;
+        juce::int64 block = 0;
+        juce::uint32 generation = 0;
+        juce::uint32 epoch = 0;
+        std::atomic<bool> ready { false };
+    };
+
+    std::array<Slot, capacity> slots;
+    int acquiredSlot = -1;
+};
+
+#endif //BINAURALPANNER_HRIRPREFETCH_H
@@ -0,0 +1,183 @@
+#include "HRIRProcessing.h"
+#include "ParallelFor.h"
+
+juce::String HRIRProcessing::getCacheSuffix() const {
+    juce::String suffix;
+
+    if (minimumPhase)
+        suffix << "_minphase" << juce::roundToInt(-truncationThresholdDb);
+
+    if (maxLength > 0)
+        suffix << "_taps" << maxLength;
+
+    return suffix;
+}
+
+int HRIRProcessing::apply(float* irs, float* delays, int numIRs, int irLength, juce::ThreadPool& pool) const {
+    if (numIRs <= 0 || irLength <= 0)
+        return irLength;
+
+    auto length = irLength;
+
+    if (minimumPhase)
+    {
+        std::atomic<int> longest { 0 };
+
+        parallelFor(pool, numIRs, [&] (int begin, int end)
+        {
+            const auto rangeLength = makeMinimumPhase(irs, delays, begin, end, irLength);
+
+            auto current = longest.load();
+            while (rangeLength > current && ! longest.compare_exchange_weak(current, rangeLength)) {}
+        });
+
+        // all filters of a set share one length, rounded up a bit
+        length = juce::jlimit(juce::jmin(8, irLength), irLength, (longest.load() + 7) & ~7);
+    }
+
+    auto fadeLength = length / 8;
+
+    // a fixed tap count cuts into the response, so it gets a longer fade
+    if (maxLength > 0 && maxLength < length)
+    {
+        // the response is kept from its onset on, not from the start of the
+        // measurement. Minimum phase filters already begin there.
+        if (! minimumPhase)
+            alignOnsets(irs, delays, numIRs, irLength, maxLength / 16);
+
+        length = maxLength;
+        fadeLength = length / 4;
+    }
+
+    if (length < irLength)
+        fadeOut(irs, numIRs, irLength, length, juce::jmax(1, fadeLength));
+
+    return length;
+}
+
+int HRIRProcessing::makeMinimumPhase(float* irs, float* delays, int begin, int end, int irLength) const {
+    // oversampled, so the folded cepstrum barely aliases
+    const auto fftOrder = juce::jmax(4, static_cast<int>(std::ceil(std::log2(static_cast<double>(irLength)))) + 2);
+    juce::dsp::FFT fft(fftOrder);
+    const auto fftSize = static_cast<size_t>(fft.getSize());
+
+    std::vector<juce::dsp::Complex<float>> buffer(fftSize), spectrum(fftSize);
+
+    const auto tailEnergyRatio = std::pow(10.0, static_cast<double>(truncationThresholdDb) / 10.0);
+    int truncatedLength = 0;
+
+    for (int i = begin; i < end; ++i)
+    {
+        auto ir = irs + static_cast<size_t>(i) * static_cast<size_t>(irLength);
+
+        // the onset is lost in the conversion, so it moves into the delay. Both are
+        // in samples at the rate of the set
+        const auto onset = findOnset(ir, irLength);
+
+        if (onset < irLength)
+            delays[i] += static_cast<float>(onset);
+
+        // real cepstrum of the magnitude response
+        std::fill(buffer.begin(), buffer.end(), juce::dsp::Complex<float>());
+        for (int n = 0; n < irLength; ++n)
+            buffer[static_cast<size_t>(n)] = ir[n];
+
+        fft.perform(buffer.data(), spectrum.data(), false);
+
+        for (size_t k = 0; k < fftSize; ++k)
+            buffer[k] = std::log(juce::jmax(std::abs(spectrum[k]), 1.0e-9f));
+
+        fft.perform(buffer.data(), spectrum.data(), true);
+
+        // folding the cepstrum onto positive quefrencies gives the minimum phase spectrum
+        buffer[0] = spectrum[0].real();
+        for (size_t n = 1; n < fftSize / 2; ++n)
+            buffer[n] = 2.0f * spectrum[n].real();
+        buffer[fftSize / 2] = spectrum[fftSize / 2].real();
+        for (size_t n = fftSize / 2 + 1; n < fftSize; ++n)
+            buffer[n] = 0.0f;
+
+        fft.perform(buffer.data(), spectrum.data(), false);
+
+        for (size_t k = 0; k < fftSize; ++k)
+            buffer[k] = std::exp(spectrum[k]);
+
+        fft.perform(buffer.data(), spectrum.data(), true);
+
+        for (int n = 0; n < irLength; ++n)
+            ir[n] = spectrum[static_cast<size_t>(n)].real();
+
+        // shortest length that keeps everything above the threshold
+        double totalEnergy = 0.0;
+        for (int n = 0; n < irLength; ++n)
+            totalEnergy += static_cast<double>(ir[n]) * ir[n];
+
+        double tailEnergy = 0.0;
+        int length = irLength;
+
+        while (length > 0)
+        {
+            const auto sample = static_cast<double>(ir[length - 1]);
+            if (tailEnergy + sample * sample > totalEnergy * tailEnergyRatio)
+                break;
+
+            tailEnergy += sample * sample;
+            --length;
+        }
+
+        truncatedLength = juce::jmax(truncatedLength, length);
+    }
+
+    return truncatedLength;
+}
+
+void HRIRProcessing::alignOnsets(float* irs, float* delays, int numIRs, int irLength, int lead) {
+    for (int i = 0; i < numIRs; ++i)
+    {
+        auto ir = irs + static_cast<size_t>(i) * static_cast<size_t>(irLength);
+
+        const auto onset = findOnset(ir, irLength);
+        if (onset >= irLength)
+            continue;
+
+        // a few samples before the onset stay, the threshold cuts into the rise
+        const auto shift = juce::jmax(0, onset - lead);
+        if (shift == 0)
+            continue;
+
+        std::copy(ir + shift, ir + irLength, ir);
+        std::fill(ir + irLength - shift, ir + irLength, 0.0f);
+        delays[i] += static_cast<float>(shift);
+    }
+}
+
+int HRIRProcessing::findOnset(const float* ir, int irLength) {
+    // -20 dB below the peak counts as the start of the response
+    constexpr float onsetThreshold = 0.1f;
+
+    const auto range = juce::FloatVectorOperations::findMinAndMax(ir, irLength);
+    const auto peak = juce::jmax(range.getEnd(), -range.getStart());
+
+    if (peak <= 0.0f)
+        return irLength;
+
+    int onset = 0;
+    while (onset < irLength && std::abs(ir[onset]) < onsetThreshold * peak)
+        ++onset;
+
+    return onset;
+}
+
+void HRIRProcessing::fadeOut(float* irs, int numIRs, int irLength, int length, int fadeLength) {
+    // half hann window over the end of the kept part, so the cut doesn't add ripple
+    for (int i = 0; i < numIRs; ++i)
+    {
+        auto ir = irs + static_cast<size_t>(i) * static_cast<size_t>(irLength);
+
+        for (int n = 0; n < fadeLength; ++n)
+        {
+            const auto phase = juce::MathConstants<float>::pi * static_cast<float>(n + 1) / static_cast<float>(fadeLength + 1);
+            ir[length - fadeLength + n] *= 0.5f * (1.0f + std::cos(phase));
+        }
+    }
+}
@@ -0,0 +1,48 @@
+#ifndef BINAURALPANNER_HRIRPROCESSING_H
+#define BINAURALPANNER_HRIRPROCESSING_H
+
+#include <JuceHeader.h>
+
+// Optional processing applied to every measurement when a dataset is opened.
+// The interaural time difference is carried by the delays only, so the filters
+// can be made minimum phase and cut down to the part that holds their energy.
+// Independently, the filters can be cut to a fixed tap count, which trades some
+// spectral detail for a smaller convolution. The cut starts at the onset of each
+// filter, the samples before it move into the delays as well.
+struct HRIRProcessing
+{
+    bool minimumPhase = false;
+    // energy left in the truncated tail, relative to the whole filter
+    float truncationThresholdDb = -60.0f;
+    // fixed tap count, 0 keeps the full length
+    int maxLength = 0;
+
+    bool operator== (const HRIRProcessing& other) const
+    {
+        return minimumPhase == other.minimumPhase
+            && (! minimumPhase || juce::exactlyEqual(truncationThresholdDb, other.truncationThresholdDb))
+            && maxLength == other.maxLength;
+    }
+
+    bool operator!= (const HRIRProcessing& other) const { return ! operator== (other); }
+
+    // distinguishes cache files of differently processed sets
+    juce::String getCacheSuffix() const;
+
+    // processes numIRs filters of irLength samples (stored one after another) in
+    // place and returns the length all of them are truncated to. Minimum phase
+    // conversion and a fixed tap count add the onsets of the filters to the
+    // matching delays. The conversion is spread across the pool.
+    int apply(float* irs, float* delays, int numIRs, int irLength, juce::ThreadPool& pool) const;
+
+private:
+    // converts the filters begin..end-1, returns the longest length they need
+    int makeMinimumPhase(float* irs, float* delays, int begin, int end, int irLength) const;
+    // moves every filter forward to lead samples before its onset
+    static void alignOnsets(float* irs, float* delays, int numIRs, int irLength, int lead);
+    // first sample that reaches onsetThreshold of the peak, irLength if the filter is silent
+    static int findOnset(const float* ir, int irLength);
+    static void fadeOut(float* irs, int numIRs, int irLength, int length, int fadeLength);
+};
+
+#endif //BINAURALPANNER_HRIRPROCESSING_H
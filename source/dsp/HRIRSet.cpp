@@ -0,0 +1,425 @@
+#include "HRIRSet.h"
+#include "ParallelFor.h"
+
+namespace
+{
+    // windowed sinc resampling of one filter, the output is aligned with the input
+    void resample(const float* input, int inputLength, float* output, int outputLength, double factor)
+    {
+        constexpr int zeroCrossings = 16;
+
+        // below the lower nyquist frequency when downsampling
+        const auto cutoff = juce::jmin(1.0, factor);
+        const auto halfWidth = zeroCrossings / cutoff;
+
+        for (int m = 0; m < outputLength; ++m)
+        {
+            const auto centre = m / factor;
+            const auto first = juce::jmax(0, static_cast<int>(std::ceil(centre - halfWidth)));
+            const auto last = juce::jmin(inputLength - 1, static_cast<int>(std::floor(centre + halfWidth)));
+
+            double sum = 0.0;
+
+            for (int n = first; n <= last; ++n)
+            {
+                const auto x = (n - centre) * cutoff;
+                const auto sinc = std::abs(x) < 1.0e-9 ? 1.0 : std::sin(juce::MathConstants<double>::pi * x) / (juce::MathConstants<double>::pi * x);
+                const auto window = 0.5 + 0.5 * std::cos(juce::MathConstants<double>::pi * x / zeroCrossings);
+                sum += input[n] * cutoff * sinc * window;
+            }
+
+            output[m] = static_cast<float>(sum);
+        }
+    }
+}
+
+std::unique_ptr<HRIRSet> HRIRSet::createFromSofa(MYSOFA_HRTF* hrtf, double sampleRate, juce::int64 sourceKey, const HRIRProcessing& processing, juce::ThreadPool& pool) {
+    std::unique_ptr<HRIRSet> set(new HRIRSet());
+    set->numMeasurements = static_cast<int>(hrtf->M);
+    set->sampleRate = sampleRate;
+    set->sourceKey = sourceKey;
+
+    const auto count = static_cast<size_t>(set->numMeasurements);
+    const auto sofaLength = static_cast<int>(hrtf->N);
+    const auto sofaRate = static_cast<double>(hrtf->DataSamplingRate.values[0]);
+
+    // same length mysofa_resample would produce
+    const auto factor = sampleRate / sofaRate;
+    const auto needsResampling = ! juce::approximatelyEqual(factor, 1.0);
+    const auto irLength = needsResampling ? static_cast<int>(std::ceil(sofaLength * factor)) : sofaLength;
+
+    // the filters are collected first, processing may shorten them
+    std::vector<float> sofaIRs(2 * count * static_cast<size_t>(irLength));
+    std::vector<float> sofaDelays(2 * count);
+
+    // measurements are independent, so resampling and delay extraction are spread across the pool
+    parallelFor(pool, set->numMeasurements, [&] (int begin, int end)
+    {
+        for (auto i = static_cast<size_t>(begin); i < static_cast<size_t>(end); ++i)
+        {
+            for (size_t ear = 0; ear < 2; ++ear)
+            {
+                auto sofaIR = hrtf->DataIR.values + (i * hrtf->R + ear) * hrtf->N;
+                auto ir = sofaIRs.data() + (2 * i + ear) * static_cast<size_t>(irLength);
+
+                if (needsResampling)
+                    resample(sofaIR, sofaLength, ir, irLength, factor);
+                else
+                    std::copy_n(sofaIR, sofaLength, ir);
+
+                // delays are either given once per receiver or per measurement, in samples
+                // of the file. They are stored in samples of the set, like the onsets
+                // minimum phase conversion adds to them
+                const auto delayIndex = hrtf->DataDelay.elements > hrtf->R ? i * hrtf->R + ear : ear;
+                sofaDelays[2 * i + ear] = static_cast<float>(hrtf->DataDelay.values[delayIndex] * factor);
+            }
+        }
+    });
+
+    // loudness normalisation like mysofa_loudness, the frontal filter gets an energy of 2
+    int frontIndex = 0;
+    float frontCosine = -2.0f;
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        auto position = hrtf->SourcePosition.values + i * hrtf->C;
+        auto radius = std::sqrt(position[0] * position[0] + position[1] * position[1] + position[2] * position[2]);
+        if (radius <= 0.0f)
+            radius = 1.0f;
+
+        // the measurement closest to the front has the largest x component
+        if (position[0] / radius > frontCosine)
+        {
+            frontIndex = static_cast<int>(i);
+            frontCosine = position[0] / radius;
+        }
+    }
+
+    double frontEnergy = 0.0;
+    for (size_t n = 0; n < 2 * static_cast<size_t>(irLength); ++n)
+    {
+        const auto sample = static_cast<double>(sofaIRs[2 * static_cast<size_t>(frontIndex) * static_cast<size_t>(irLength) + n]);
+        frontEnergy += sample * sample;
+    }
+
+    const auto gain = frontEnergy > 0.0 ? static_cast<float>(std::sqrt(2.0 / frontEnergy)) : 1.0f;
+
+    set->irLength = processing.apply(sofaIRs.data(), sofaDelays.data(), static_cast<int>(2 * count), irLength, pool);
+
+    set->ownedData.resize(getDataSize(count, static_cast<size_t>(set->irLength)));
+    set->setDataPointers(set->ownedData.data());
+
+    auto positions = reinterpret_cast<float*>(set->ownedData.data());
+    auto irs = positions + 3 * count;
+    auto delays = irs + 2 * count * static_cast<size_t>(set->irLength);
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        // source positions are cartesian after mysofa_tocartesian
+        auto position = hrtf->SourcePosition.values + i * hrtf->C;
+
+        auto radius = std::sqrt(position[0] * position[0] + position[1] * position[1] + position[2] * position[2]);
+        if (radius <= 0.0f)
+            radius = 1.0f;
+
+        for (size_t c = 0; c < 3; ++c)
+            positions[3 * i + c] = position[c] / radius;
+
+        for (size_t ear = 0; ear < 2; ++ear)
+        {
+            juce::FloatVectorOperations::copyWithMultiply(irs + (2 * i + ear) * static_cast<size_t>(set->irLength),
+                                                          sofaIRs.data() + (2 * i + ear) * static_cast<size_t>(irLength),
+                                                          gain,
+                                                          set->irLength);
+            delays[2 * i + ear] = sofaDelays[2 * i + ear];
+        }
+    }
+
+    // the grid is stored behind the delays, so it ends up in the cache file as well
+    std::vector<DirectionCell> grid;
+    set->buildDirectionGrid(grid, pool);
+    std::memcpy(delays + 2 * count, grid.data(), gridSize * sizeof(DirectionCell));
+
+    set->triangulation.build(positions, set->numMeasurements);
+
+    return set;
+}
+
+std::unique_ptr<HRIRSet> HRIRSet::loadFromCacheFile(const juce::File& file, double sampleRate, juce::int64 sourceKey) {
+    if (! file.existsAsFile())
+        return nullptr;
+
+    auto mappedFile = std::make_unique<juce::MemoryMappedFile>(file, juce::MemoryMappedFile::readOnly);
+    if (mappedFile->getData() == nullptr || mappedFile->getSize() < sizeof(CacheHeader))
+        return nullptr;
+
+    CacheHeader header {};
+    std::memcpy(&header, mappedFile->getData(), sizeof(CacheHeader));
+
+    if (std::memcmp(header.magic, "OHRS", 4) != 0
+        || header.version != cacheVersion
+        || header.sampleRate != sampleRate
+        || header.sourceKey != sourceKey)
+        return nullptr;
+
+    const auto dataSize = getDataSize(header.numMeasurements, header.irLength);
+
+    if (mappedFile->getSize() != sizeof(CacheHeader) + dataSize + header.triangulationSize * sizeof(juce::int32))
+        return nullptr;
+
+    std::unique_ptr<HRIRSet> set(new HRIRSet());
+    set->numMeasurements = static_cast<int>(header.numMeasurements);
+    set->irLength = static_cast<int>(header.irLength);
+    set->sampleRate = header.sampleRate;
+    set->sourceKey = header.sourceKey;
+    set->setDataPointers(static_cast<const char*>(mappedFile->getData()) + sizeof(CacheHeader));
+
+    // the triangulation is small, so it is copied out of the file
+    auto triangulationData = reinterpret_cast<const juce::int32*>(static_cast<const char*>(mappedFile->getData()) + sizeof(CacheHeader) + dataSize);
+    set->triangulation.restore(set->positions, set->numMeasurements, triangulationData, header.triangulationSize);
+
+    set->mappedFile = std::move(mappedFile);
+
+    return set;
+}
+
+bool HRIRSet::writeToCacheFile(const juce::File& file) const {
+    if (! file.getParentDirectory().createDirectory().wasOk())
+        return false;
+
+    std::vector<juce::int32> triangulationData;
+    triangulation.serialise(triangulationData);
+
+    CacheHeader header {};
+    std::memcpy(header.magic, "OHRS", 4);
+    header.version = cacheVersion;
+    header.numMeasurements = static_cast<juce::uint32>(numMeasurements);
+    header.irLength = static_cast<juce::uint32>(irLength);
+    header.sampleRate = sampleRate;
+    header.sourceKey = sourceKey;
+    header.triangulationSize = static_cast<juce::uint32>(triangulationData.size());
+
+    const auto dataSize = getDataSize(static_cast<size_t>(numMeasurements), static_cast<size_t>(irLength));
+
+    // write to a temporary file first, so other instances never map a half written cache
+    juce::TemporaryFile tempFile(file);
+    {
+        juce::FileOutputStream stream(tempFile.getFile());
+        if (! stream.openedOk())
+            return false;
+
+        if (! stream.write(&header, sizeof(CacheHeader))
+            || ! stream.write(positions, dataSize)
+            || ! stream.write(triangulationData.data(), triangulationData.size() * sizeof(juce::int32)))
+            return false;
+
+        stream.flush();
+        if (stream.getStatus().failed())
+            return false;
+    }
+
+    return tempFile.overwriteTargetFileWithTemporary();
+}
+
+size_t HRIRSet::getDataSize(size_t count, size_t length) {
+    return count * (3 + 2 * length + 2) * sizeof(float) + gridSize * sizeof(DirectionCell);
+}
+
+void HRIRSet::setDataPointers(const void* data) {
+    const auto count = static_cast<size_t>(numMeasurements);
+    positions = static_cast<const float*>(data);
+    irs = positions + 3 * count;
+    delays = irs + 2 * count * static_cast<size_t>(irLength);
+    directionGrid = reinterpret_cast<const DirectionCell*>(delays + 2 * count);
+}
+
+int HRIRSet::findNearest(const float* direction, int k, int* indices, float* distances) const {
+    auto radius = std::sqrt(direction[0] * direction[0] + direction[1] * direction[1] + direction[2] * direction[2]);
+    if (radius <= 0.0f)
+        radius = 1.0f;
+
+    const float query[3] = { direction[0] / radius, direction[1] / radius, direction[2] / radius };
+
+    int found = 0;
+
+    for (int i = 0; i < numMeasurements; ++i)
+    {
+        auto position = getPosition(i);
+        auto dx = position[0] - query[0];
+        auto dy = position[1] - query[1];
+        auto dz = position[2] - query[2];
+        auto distance = dx * dx + dy * dy + dz * dz;
+
+        if (found == k && distance >= distances[k - 1])
+            continue;
+
+        // insertion into the sorted candidate list
+        int slot = found < k ? found++ : k - 1;
+        while (slot > 0 && distances[slot - 1] > distance)
+        {
+            distances[slot] = distances[slot - 1];
+            indices[slot] = indices[slot - 1];
+            --slot;
+        }
+        distances[slot] = distance;
+        indices[slot] = i;
+    }
+
+    for (int i = 0; i < found; ++i)
+        distances[i] = std::sqrt(distances[i]);
+
+    return found;
+}
+
+int HRIRSet::findNearest(const float* direction) const {
+    int index = 0;
+    float distance = 0.0f;
+    return findNearest(direction, 1, &index, &distance) > 0 ? index : -1;
+}
+
+void HRIRSet::buildNeighbourhoods(std::vector<Neighbourhood>& neighbourhoods, juce::ThreadPool& pool) const {
+    neighbourhoods.resize(static_cast<size_t>(numMeasurements));
+
+    // like mysofa_neighborhood_init: walks away from every measurement in azimuth and
+    // in elevation, in steps of half a degree up to 45 degrees, until another
+    // measurement is the closest one
+    constexpr float angleStep = 0.5f;
+    constexpr float maxAngle = 45.0f;
+
+    parallelFor(pool, numMeasurements, [&] (int begin, int end)
+    {
+        for (int i = begin; i < end; ++i)
+        {
+            float origin[3] = { getPosition(i)[0], getPosition(i)[1], getPosition(i)[2] };
+            mysofa_c2s(origin);
+
+            auto& neighbourhood = neighbourhoods[static_cast<size_t>(i)];
+
+            for (int side = 0; side < 4; ++side)
+            {
+                neighbourhood.indices[side] = -1;
+
+                const auto axis = side / 2;
+                const auto sign = side % 2 == 0 ? 1.0f : -1.0f;
+
+                for (auto angle = angleStep; angle <= maxAngle; angle += angleStep)
+                {
+                    float test[3] = { origin[0], origin[1], 1.0f };
+                    test[axis] += sign * angle;
+                    mysofa_s2c(test);
+
+                    const auto index = findNearest(test);
+
+                    if (index != i)
+                    {
+                        neighbourhood.indices[side] = index;
+                        break;
+                    }
+                }
+            }
+        }
+    });
+}
+
+void HRIRSet::buildDirectionGrid(std::vector<DirectionCell>& grid, juce::ThreadPool& pool) const {
+    std::vector<Neighbourhood> neighbourhoods;
+    buildNeighbourhoods(neighbourhoods, pool);
+
+    grid.resize(gridSize);
+
+    const auto getDistance = [this] (const float* direction, int index)
+    {
+        auto position = getPosition(index);
+        return std::sqrt((position[0] - direction[0]) * (position[0] - direction[0])
+                         + (position[1] - direction[1]) * (position[1] - direction[1])
+                         + (position[2] - direction[2]) * (position[2] - direction[2]));
+    };
+
+    // rows are independent, each one searches all measurements per cell
+    parallelFor(pool, gridElevationCells, [&] (int firstRow, int endRow)
+    {
+        for (int e = firstRow; e < endRow; ++e)
+        {
+            for (int a = 0; a < gridAzimuthCells; ++a)
+            {
+                float direction[3] = { static_cast<float>(a - gridAzimuthCells / 2),
+                                       static_cast<float>(e - gridElevationCells / 2),
+                                       1.0f };
+                mysofa_s2c(direction);
+
+                auto& cell = grid[static_cast<size_t>(e * gridAzimuthCells + a)];
+                const auto nearest = juce::jmax(0, findNearest(direction));
+
+                for (int i = 0; i < numNeighbours; ++i)
+                {
+                    cell.indices[i] = nearest;
+                    cell.weights[i] = 0.0f;
+                }
+
+                // the interpolation of mysofa_getfilter_float: the closest measurement,
+                // plus the closer of its two neighbours in azimuth and in elevation, by
+                // inverse distance. An exact hit only uses that measurement.
+                const auto nearestDistance = getDistance(direction, nearest);
+
+                if (nearestDistance < 1.0e-6f)
+                {
+                    cell.weights[0] = 1.0f;
+                    continue;
+                }
+
+                cell.weights[0] = 1.0f / nearestDistance;
+                float weightSum = cell.weights[0];
+
+                const auto& neighbourhood = neighbourhoods[static_cast<size_t>(nearest)];
+
+                for (int axis = 0; axis < 2; ++axis)
+                {
+                    const auto first = neighbourhood.indices[2 * axis];
+                    const auto second = neighbourhood.indices[2 * axis + 1];
+                    const auto firstDistance = first >= 0 ? getDistance(direction, first) : 0.0f;
+                    const auto secondDistance = second >= 0 ? getDistance(direction, second) : 0.0f;
+
+                    // with both sides equally far, mysofa uses neither
+                    int index = -1;
+                    float distance = 0.0f;
+
+                    if (first >= 0 && second >= 0)
+                    {
+                        if (! juce::approximatelyEqual(firstDistance, secondDistance))
+                        {
+                            index = firstDistance < secondDistance ? first : second;
+                            distance = juce::jmin(firstDistance, secondDistance);
+                        }
+                    }
+                    else if (first >= 0 || second >= 0)
+                    {
+                        index = first >= 0 ? first : second;
+                        distance = first >= 0 ? firstDistance : secondDistance;
+                    }
+
+                    if (index < 0 || distance <= 0.0f)
+                        continue;
+
+                    cell.indices[axis + 1] = index;
+                    cell.weights[axis + 1] = 1.0f / distance;
+                    weightSum += cell.weights[axis + 1];
+                }
+
+                for (auto& weight : cell.weights)
+                    weight /= weightSum;
+            }
+        }
+    });
+}
+
+const HRIRSet::DirectionCell& HRIRSet::lookupDirection(float azimuth, float elevation) const {
+    auto a = juce::roundToInt(azimuth) % 360;
+    if (a < -180)
+        a += 360;
+    else if (a >= 180)
+        a -= 360;
+
+    const auto e = juce::jlimit(-90, 90, juce::roundToInt(elevation));
+
+    return directionGrid[static_cast<size_t>((e + gridElevationCells / 2) * gridAzimuthCells + (a + gridAzimuthCells / 2))];
+}
@@ -0,0 +1,106 @@
+#ifndef BINAURALPANNER_HRIRSET_H
+#define BINAURALPANNER_HRIRSET_H
+
+#include <JuceHeader.h>
+#include <mysofa.h>
+#include "SphericalTriangulation.h"
+#include "HRIRProcessing.h"
+
+// Flat, read-only view of all measurements of a sofa dataset at one samplerate.
+// The data either lives in memory or in a memory-mapped cache file, so instances
+// that load the same dataset share its pages.
+class HRIRSet {
+public:
+    // measurements blended for one direction, like mysofa_getfilter_float does: the
+    // closest one and its closer neighbour in azimuth and in elevation
+    static constexpr int numNeighbours = 3;
+
+    // neighbours and normalised interpolation weights of one cell of the direction grid
+    struct DirectionCell
+    {
+        juce::int32 indices[numNeighbours];
+        float weights[numNeighbours];
+    };
+
+    // resamples, normalises and processes every measurement of a loaded sofa file
+    // (with cartesian source positions), the work is spread across the pool
+    static std::unique_ptr<HRIRSet> createFromSofa(MYSOFA_HRTF* hrtf, double sampleRate, juce::int64 sourceKey, const HRIRProcessing& processing, juce::ThreadPool& pool);
+    // maps a cache file written by writeToCacheFile, returns nullptr if it is missing or stale
+    static std::unique_ptr<HRIRSet> loadFromCacheFile(const juce::File& file, double sampleRate, juce::int64 sourceKey);
+
+    bool writeToCacheFile(const juce::File& file) const;
+
+    int getNumMeasurements() const { return numMeasurements; }
+    int getIRLength() const { return irLength; }
+    double getSampleRate() const { return sampleRate; }
+    // average angle between neighbouring measurements in degrees, as if they covered the sphere evenly
+    float getGridSpacing() const { return numMeasurements > 0 ? juce::radiansToDegrees(std::sqrt(4.0f * juce::MathConstants<float>::pi / static_cast<float>(numMeasurements))) : 0.0f; }
+
+    // unit direction vector (x, y, z) of a measurement
+    const float* getPosition(int index) const { return positions + 3 * static_cast<size_t>(index); }
+    const float* getIR(int index, int ear) const { return irs + (2 * static_cast<size_t>(index) + static_cast<size_t>(ear)) * static_cast<size_t>(irLength); }
+    // in samples at the sample rate of the set, which is what the delay lines take
+    float getDelay(int index, int ear) const { return delays[2 * static_cast<size_t>(index) + static_cast<size_t>(ear)]; }
+
+    // finds the k measurements closest to the direction (x, y, z), sorted by distance
+    int findNearest(const float* direction, int k, int* indices, float* distances) const;
+    // the closest measurement, or -1 if there are none
+    int findNearest(const float* direction) const;
+
+    // constant time lookup in the precomputed direction grid, angles in degrees
+    const DirectionCell& lookupDirection(float azimuth, float elevation) const;
+
+    // delaunay triangulation of the measurement directions, for barycentric interpolation
+    const SphericalTriangulation& getTriangulation() const { return triangulation; }
+
+private:
+    HRIRSet() = default;
+
+    void setDataPointers(const void* data);
+    // measurements next to each one, in positive and negative azimuth, then elevation
+    struct Neighbourhood
+    {
+        int indices[4];
+    };
+
+    void buildNeighbourhoods(std::vector<Neighbourhood>& neighbourhoods, juce::ThreadPool& pool) const;
+    void buildDirectionGrid(std::vector<DirectionCell>& grid, juce::ThreadPool& pool) const;
+    static size_t getDataSize(size_t numMeasurements, size_t irLength);
+
+    // 1 degree cells, azimuth -180..179 and elevation -90..90
+    static constexpr int gridAzimuthCells = 360;
+    static constexpr int gridElevationCells = 181;
+    static constexpr size_t gridSize = static_cast<size_t>(gridAzimuthCells) * gridElevationCells;
+
+    struct CacheHeader
+    {
+        char magic[4];
+        juce::uint32 version;
+        juce::uint32 numMeasurements;
+        juce::uint32 irLength;
+        double sampleRate;
+        juce::int64 sourceKey;
+        juce::uint32 triangulationSize;
+    };
+
+    // bump when the layout or the processing of the cached data changes
+    static constexpr juce::uint32 cacheVersion = 8;
+
+    int numMeasurements = 0;
+    int irLength = 0;
+    double sampleRate = 0.0;
+    // tells the sofa data the set was built from apart, see SofaReader::get_source_key
+    juce::int64 sourceKey = 0;
+
+    std::vector<char> ownedData;
+    std::unique_ptr<juce::MemoryMappedFile> mappedFile;
+
+    const float* positions = nullptr;
+    const float* irs = nullptr;
+    const float* delays = nullptr;
+    const DirectionCell* directionGrid = nullptr;
+
+    SphericalTriangulation triangulation;
+};
+
+#endif //BINAURALPANNER_HRIRSET_H
@@ -0,0 +1,32 @@
+#include "HRIRSetRegistry.h"
+
+std::shared_ptr<const HRIRSet> HRIRSetRegistry::getOrCreate(const juce::String& key, const std::function<std::shared_ptr<const HRIRSet>()>& create) {
+    std::shared_ptr<Entry> entry;
+    {
+        const juce::ScopedLock sl(lock);
+
+        // forget datasets nobody uses anymore, unless someone is building one right now
+        for (auto it = entries.begin(); it != entries.end();)
+        {
+            if (it->second.use_count() == 1 && it->second->hrirs.expired())
+                it = entries.erase(it);
+            else
+                ++it;
+        }
+
+        auto& slot = entries[key];
+        if (slot == nullptr)
+            slot = std::make_shared<Entry>();
+
+        entry = slot;
+    }
+
+    const juce::ScopedLock sl(entry->buildLock);
+
+    if (auto hrirs = entry->hrirs.lock())
+        return hrirs;
+
+    auto hrirs = create();
+    entry->hrirs = hrirs;
+    return hrirs;
+}
@@ -0,0 +1,29 @@
+#ifndef BINAURALPANNER_HRIRSETREGISTRY_H
+#define BINAURALPANNER_HRIRSETREGISTRY_H
+
+#include <JuceHeader.h>
+#include "HRIRSet.h"
+
+// Datasets that are open in any instance of the plugin, keyed by their cache file
+// (dataset, samplerate and processing). Held through a SharedResourcePointer, so
+// there is one registry per process. It doesn't own the datasets, a dataset is
+// freed when the last instance using it lets go.
+class HRIRSetRegistry {
+public:
+    // returns the dataset registered under key, or registers the one create returns.
+    // Instances asking for the same key at the same time wait for a single create,
+    // different keys are built concurrently. create may return nullptr.
+    std::shared_ptr<const HRIRSet> getOrCreate(const juce::String& key, const std::function<std::shared_ptr<const HRIRSet>()>& create);
+
+private:
+    struct Entry
+    {
+        juce::CriticalSection buildLock;
+        std::weak_ptr<const HRIRSet> hrirs;
+    };
+
+    juce::CriticalSection lock;
+    std::map<juce::String, std::shared_ptr<Entry>> entries;
+};
+
+#endif //BINAURALPANNER_HRIRSETREGISTRY_H
@@ -0,0 +1,28 @@
+#include "HRIRTransitionPolicy.h"
+#include "HRIRUpdatePolicy.h"
+
+double HRIRTransitionPolicy::getTransitionTime(float azimuth, float elevation) {
+    auto scale = 1.0f;
+
+    // while a transition runs, the selection is retried every block, so the angle
+    // has to be taken from where the last one went, not from the last call
+    if (adaptive.load() && hasDirection) {
+        const auto angle = HRIRUpdatePolicy::angleBetween(lastAzimuth, lastElevation, azimuth, elevation);
+        scale = juce::jlimit(minScale, maxScale, angle / referenceAngle);
+    }
+
+    pendingAzimuth = azimuth;
+    pendingElevation = elevation;
+
+    return scale * timeMs.load() / 1000.0;
+}
+
+void HRIRTransitionPolicy::transitionStarted() {
+    hasDirection = true;
+    lastAzimuth = pendingAzimuth;
+    lastElevation = pendingElevation;
+}
+
+void HRIRTransitionPolicy::reset() {
+    hasDirection = false;
+}
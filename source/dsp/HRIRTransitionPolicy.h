@@ -0,0 +1,38 @@
+#ifndef BINAURALPANNER_HRIRTRANSITIONPOLICY_H
+#define BINAURALPANNER_HRIRTRANSITIONPOLICY_H
+
+#include <JuceHeader.h>
+
+// Decides how long the convolution crossfades to a new hrir. With the adaptive
+// mode the fade follows the angle to the direction of the last transition that
+// the convolution actually started: small steps are
+// inaudible after a short fade, which frees the convolution for the next one,
+// large jumps get a longer fade to hide the change of colour.
+class HRIRTransitionPolicy {
+public:
+    // fade for every change, or for a jump of referenceAngle in the adaptive mode
+    std::atomic<float> timeMs { 100.0f };
+    std::atomic<bool> adaptive { false };
+
+    // fade in seconds for a change to the given direction, in degrees, which
+    // becomes the pending one until transitionStarted()
+    double getTransitionTime(float azimuth, float elevation);
+    // the pending direction is the one the convolution fades to now
+    void transitionStarted();
+    // the next change gets the plain fade time
+    void reset();
+
+private:
+    static constexpr float referenceAngle = 15.0f;
+    // bounds of the adaptive fade, relative to timeMs
+    static constexpr float minScale = 0.25f;
+    static constexpr float maxScale = 2.0f;
+
+    bool hasDirection = false;
+    float lastAzimuth = 0.0f;
+    float lastElevation = 0.0f;
+    float pendingAzimuth = 0.0f;
+    float pendingElevation = 0.0f;
+};
+
+#endif //BINAURALPANNER_HRIRTRANSITIONPOLICY_H
@@ -0,0 +1,48 @@
+#include "HRIRUpdatePolicy.h"
+
+bool HRIRUpdatePolicy::shouldUpdate(float azimuth, float elevation, double timeMs, float gridSpacing) {
+    if (hasRequest)
+    {
+        const auto seconds = static_cast<float>((timeMs - requestTimeMs) / 1000.0);
+
+        // a pause in the motion starts the estimate over
+        if (seconds > 0.5f)
+            speed = 0.0f;
+        else if (seconds > 0.0f)
+            speed += 0.3f * (angleBetween(requestedAzimuth, requestedElevation, azimuth, elevation) / seconds - speed);
+    }
+
+    hasRequest = true;
+    requestedAzimuth = azimuth;
+    requestedElevation = elevation;
+    requestTimeMs = timeMs;
+
+    if (! hasLoaded || threshold <= 0.0f || gridSpacing <= 0.0f)
+        return true;
+
+    // never skips more than one cell of the grid
+    const auto deadBand = juce::jmin(gridSpacing, threshold * gridSpacing * (1.0f + speed / referenceSpeed));
+    return angleBetween(loadedAzimuth, loadedElevation, azimuth, elevation) >= deadBand;
+}
+
+void HRIRUpdatePolicy::loaded(float azimuth, float elevation) {
+    hasLoaded = true;
+    loadedAzimuth = azimuth;
+    loadedElevation = elevation;
+}
+
+void HRIRUpdatePolicy::reset() {
+    hasLoaded = false;
+}
+
+float HRIRUpdatePolicy::angleBetween(float azimuth1, float elevation1, float azimuth2, float elevation2) {
+    const auto az1 = juce::degreesToRadians(azimuth1), el1 = juce::degreesToRadians(elevation1);
+    const auto az2 = juce::degreesToRadians(azimuth2), el2 = juce::degreesToRadians(elevation2);
+
+    // great circle distance, stable for small angles
+    const auto sinHalfEl = std::sin(0.5f * (el2 - el1));
+    const auto sinHalfAz = std::sin(0.5f * (az2 - az1));
+    const auto h = sinHalfEl * sinHalfEl + std::cos(el1) * std::cos(el2) * sinHalfAz * sinHalfAz;
+
+    return juce::radiansToDegrees(2.0f * std::asin(std::sqrt(juce::jlimit(0.0f, 1.0f, h))));
+}
@@ -0,0 +1,40 @@
+#ifndef BINAURALPANNER_HRIRUPDATEPOLICY_H
+#define BINAURALPANNER_HRIRUPDATEPOLICY_H
+
+#include <JuceHeader.h>
+
+// Decides whether a requested direction is worth a new hrir. Changes inside a
+// dead-band around the loaded direction are skipped. The dead-band is a fraction
+// of the spacing of the measurement grid and widens while the source moves fast,
+// because small steps are harder to hear then. Skipped targets have to be loaded
+// eventually, that is up to the caller.
+class HRIRUpdatePolicy {
+public:
+    // fraction of the grid spacing, 0 loads every change
+    float threshold = 0.25f;
+
+    // angles in degrees, timeMs is when the direction was requested
+    bool shouldUpdate(float azimuth, float elevation, double timeMs, float gridSpacing);
+    void loaded(float azimuth, float elevation);
+    // the next request is loaded whatever its direction
+    void reset();
+
+    static float angleBetween(float azimuth1, float elevation1, float azimuth2, float elevation2);
+
+private:
+    // speed at which the dead-band has doubled, in degrees per second
+    static constexpr float referenceSpeed = 90.0f;
+
+    bool hasLoaded = false;
+    float loadedAzimuth = 0.0f;
+    float loadedElevation = 0.0f;
+
+    bool hasRequest = false;
+    float requestedAzimuth = 0.0f;
+    float requestedElevation = 0.0f;
+    double requestTimeMs = 0.0;
+    // smoothed angular speed of the requests, in degrees per second
+    float speed = 0.0f;
+};
+
+#endif //BINAURALPANNER_HRIRUPDATEPOLICY_H
@@ -0,0 +1,190 @@
+#include "HRIRWorkerPool.h"
+
+#if JUCE_WINDOWS
+ #ifndef NOMINMAX
+  #define NOMINMAX
+ #endif
+ #include <windows.h>
+#elif JUCE_MAC || JUCE_IOS
+ #include <dispatch/dispatch.h>
+#else
+ #include <cerrno>
+ #include <semaphore.h>
+#endif
+
+// Counting semaphore of the operating system. Posting doesn't take a lock and
+// only enters the kernel if a thread is waiting, unlike juce::WaitableEvent.
+class HRIRWorkerPool::Semaphore {
+public:
+   #if JUCE_WINDOWS
+    Semaphore() : handle(CreateSemaphore(nullptr, 0, LONG_MAX, nullptr)) {}
+    ~Semaphore() { CloseHandle(handle); }
+    void post() { ReleaseSemaphore(handle, 1, nullptr); }
+    void wait() { WaitForSingleObject(handle, INFINITE); }
+
+private:
+    HANDLE handle;
+   #elif JUCE_MAC || JUCE_IOS
+    Semaphore() : handle(dispatch_semaphore_create(0)) {}
+    ~Semaphore() { dispatch_release(handle); }
+    void post() { dispatch_semaphore_signal(handle); }
+    void wait() { dispatch_semaphore_wait(handle, DISPATCH_TIME_FOREVER); }
+
+private:
+    dispatch_semaphore_t handle;
+   #else
+    Semaphore() { sem_init(&handle, 0, 0); }
+    ~Semaphore() { sem_destroy(&handle); }
+    void post() { sem_post(&handle); }
+    void wait() { while (sem_wait(&handle) != 0 && errno == EINTR) {} }
+
+private:
+    sem_t handle;
+   #endif
+
+    JUCE_DECLARE_NON_COPYABLE (Semaphore)
+};
+
+class HRIRWorkerPool::Worker : public juce::Thread {
+public:
+    explicit Worker(HRIRWorkerPool& p) : juce::Thread("HRIRWorker"), pool(p) {}
+
+    void run() override {
+        while (! threadShouldExit()) {
+            auto* client = pool.takeNextClient();
+
+            if (client == nullptr) {
+                // counted as idle before looking again, so that a notify() in between
+                // is either seen here or wakes this worker
+                pool.numIdleWorkers.fetch_add(1);
+                client = pool.takeNextClient();
+
+                if (client == nullptr) {
+                    pool.workAvailable->wait();
+                    pool.wakePosted.store(false);
+                }
+
+                pool.numIdleWorkers.fetch_sub(1);
+
+                if (client == nullptr)
+                    continue;
+            }
+
+            bool hasMoreWork = false;
+
+            for (int i = 0; i < jobsPerTurn && ! threadShouldExit(); ++i)
+                if (! (hasMoreWork = client->runNextJob()))
+                    break;
+
+            // back in line behind the other clients
+            if (hasMoreWork)
+                client->pending.store(true);
+
+            client->running.store(false);
+        }
+    }
+
+private:
+    HRIRWorkerPool& pool;
+};
+
+HRIRWorkerPool::HRIRWorkerPool() : workAvailable(std::make_unique<Semaphore>()) {
+    // loading is mostly waiting for the audio thread, a few workers serve any number of instances
+    const auto numWorkers = juce::jlimit(1, 4, juce::SystemStats::getNumCpus() / 2);
+
+    for (int i = 0; i < numWorkers; ++i)
+        workers.add(new Worker(*this))->startThread(juce::Thread::Priority::high);
+
+    startTimer(housekeepingIntervalMs);
+}
+
+HRIRWorkerPool::~HRIRWorkerPool() {
+    stopTimer();
+
+    for (auto* worker : workers)
+        worker->signalThreadShouldExit();
+
+    // every waiting worker needs its own wake up
+    for (int i = 0; i < workers.size(); ++i)
+        workAvailable->post();
+
+    for (auto* worker : workers)
+        worker->waitForThreadToExit(-1);
+}
+
+void HRIRWorkerPool::addClient(Client& client) {
+    {
+        const juce::ScopedLock sl(lock);
+        clients.push_back(&client);
+    }
+
+    // requests that came in while the client wasn't registered
+    if (client.pending.load())
+        wakeWorker();
+}
+
+void HRIRWorkerPool::removeClient(Client& client) {
+    {
+        const juce::ScopedLock sl(lock);
+        clients.erase(std::remove(clients.begin(), clients.end(), &client), clients.end());
+        nextClient = clients.empty() ? 0 : nextClient % clients.size();
+    }
+
+    // a worker that took the client before it was removed finishes its turn
+    while (client.running.load())
+        juce::Thread::sleep(1);
+}
+
+void HRIRWorkerPool::notify(Client& client) {
+    client.pending.store(true);
+    wakeWorker();
+}
+
+void HRIRWorkerPool::wakeWorker() {
+    // one post at a time, the woken worker passes the work on if there is more
+    if (numIdleWorkers.load() > 0 && ! wakePosted.exchange(true))
+        workAvailable->post();
+}
+
+HRIRWorkerPool::Client* HRIRWorkerPool::takeNextClient() {
+    const juce::ScopedLock sl(lock);
+
+    Client* taken = nullptr;
+
+    for (size_t n = 0; n < clients.size(); ++n)
+    {
+        const auto index = (nextClient + n) % clients.size();
+        auto* client = clients[index];
+
+        // a client is only run by one worker at a time
+        if (! client->pending.load() || client->running.load())
+            continue;
+
+        if (taken != nullptr)
+        {
+            // another client is waiting, wake an idle worker for it
+            wakeWorker();
+            break;
+        }
+
+        client->running.store(true);
+        client->pending.store(false);
+        nextClient = (index + 1) % clients.size();
+        taken = client;
+    }
+
+    return taken;
+}
+
+void HRIRWorkerPool::scheduleAll() {
+    const juce::ScopedLock sl(lock);
+
+    for (auto* client : clients)
+        client->pending.store(true);
+}
+
+void HRIRWorkerPool::timerCallback() {
+    // idle clients get a turn now and then, to close datasets they don't use anymore
+    scheduleAll();
+    wakeWorker();
+}
@@ -0,0 +1,66 @@
+#ifndef BINAURALPANNER_HRIRWORKERPOOL_H
+#define BINAURALPANNER_HRIRWORKERPOOL_H
+
+#include <JuceHeader.h>
+
+// Process-wide worker threads shared by the hrir loaders of all plugin instances,
+// held through a SharedResourcePointer. A fixed number of workers serves every
+// registered client in turn, a client gets a few jobs per turn before the next
+// one with pending work is served.
+class HRIRWorkerPool : private juce::Timer {
+public:
+    class Client {
+    public:
+        virtual ~Client() = default;
+        // does one piece of work, returns false if there was nothing to do
+        virtual bool runNextJob() = 0;
+
+    private:
+        friend class HRIRWorkerPool;
+        std::atomic<bool> pending { false };
+        std::atomic<bool> running { false };
+    };
+
+    HRIRWorkerPool();
+    ~HRIRWorkerPool();
+
+    void addClient(Client& client);
+    // returns once no worker runs the client anymore
+    void removeClient(Client& client);
+    // schedules the client and wakes an idle worker, lock-free so it may be called from
+    // the audio thread
+    void notify(Client& client);
+
+    // for parallel work inside a job, e.g. processing the measurements of a dataset.
+    // Separate from the workers, so a job can block on it.
+    juce::ThreadPool& getIngestionPool() { return ingestionPool; }
+
+private:
+    class Worker;
+    class Semaphore;
+
+    Client* takeNextClient();
+    void scheduleAll();
+    void wakeWorker();
+    void timerCallback() override;
+
+    // jobs a client may run before the other clients get their turn
+    static constexpr int jobsPerTurn = 4;
+    // idle clients are woken this often, to close datasets they don't use anymore
+    static constexpr int housekeepingIntervalMs = 5000;
+
+    juce::CriticalSection lock;
+    std::vector<Client*> clients;
+    size_t nextClient = 0;
+
+    // idle workers block on it without a timeout
+    std::unique_ptr<Semaphore> workAvailable;
+    std::atomic<int> numIdleWorkers { 0 };
+    std::atomic<bool> wakePosted { false };
+    juce::OwnedArray<Worker> workers;
+    juce::ThreadPool ingestionPool { juce::SystemStats::getNumCpus() };
+
+    JUCE_DECLARE_NON_COPYABLE (HRIRWorkerPool)
+};
+
+#endif //BINAURALPANNER_HRIRWORKERPOOL_H
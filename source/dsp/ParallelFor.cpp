@@ -0,0 +1,34 @@
+#include "ParallelFor.h"
+
+void parallelFor(juce::ThreadPool& pool, int numItems, const std::function<void(int begin, int end)>& work) {
+    if (numItems <= 0)
+        return;
+
+    // a few ranges per thread, so uneven ranges still balance out
+    const auto numRanges = juce::jmin(numItems, 4 * juce::jmax(1, pool.getNumThreads()));
+
+    if (numRanges == 1)
+    {
+        work(0, numItems);
+        return;
+    }
+
+    std::atomic<int> remaining { numRanges };
+    juce::WaitableEvent finished;
+
+    for (int range = 0; range < numRanges; ++range)
+    {
+        const auto begin = static_cast<int>(static_cast<juce::int64>(numItems) * range / numRanges);
+        const auto end = static_cast<int>(static_cast<juce::int64>(numItems) * (range + 1) / numRanges);
+
+        pool.addJob([&work, &remaining, &finished, begin, end]
+        {
+            work(begin, end);
+
+            if (--remaining == 0)
+                finished.signal();
+        });
+    }
+
+    finished.wait();
+}
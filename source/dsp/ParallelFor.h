@@ -0,0 +1,11 @@
+#ifndef BINAURALPANNER_PARALLELFOR_H
+#define BINAURALPANNER_PARALLELFOR_H
+
+#include <JuceHeader.h>
+
+// Splits the items 0..numItems-1 into contiguous ranges, runs work(begin, end)
+// for every range on the pool and blocks until all of them are done.
+// Must not be called from one of the pool's own threads.
+void parallelFor(juce::ThreadPool& pool, int numItems, const std::function<void(int begin, int end)>& work);
+
+#endif //BINAURALPANNER_PARALLELFOR_H
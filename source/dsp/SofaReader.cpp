@@ -1,181 +1,343 @@
 #include "SofaReader.h"
 
 SofaReader::~SofaReader() {
-    
-    //MEASURED
-    mysofa_close(*sofa_measured);
-    sofa_measured.reset();
-    
-    // INTERPOLATION SH
-    mysofa_close(*sofa_interpolated_sh);
-    sofa_interpolated_sh.reset();
-    
-    // INTERPOLATION SH TIMEALIGNED
-    mysofa_close(*sofa_interpolated_sh_timealign);
-    sofa_interpolated_sh_timealign.reset();
-    
-    // INTERPOLATION MCA
-    mysofa_close(*sofa_interpolated_mca);
-    sofa_interpolated_mca.reset();
-}
-
-void SofaReader::prepare(double samplerate)
+    for (int i = 0; i < num_datasets; ++i)
+        close_dataset(static_cast<sofaChoices>(i));
+}
+
+void SofaReader::prepare(double samplerate, sofaChoices activeChoice)
 {
-    // MEASURED
-    auto sofaBinary = BinaryData::pp2_HRIRs_measured_time_aligned_sofa;
-    auto sofaSizeBinary = BinaryData::pp2_HRIRs_measured_time_aligned_sofaSize;
-    
-    if (sofa_measured != nullptr)
+    // the filters are resampled when opening, so a new samplerate invalidates every dataset
+    if (samplerate != current_samplerate)
     {
-        sofa_measured.reset();
+        for (int i = 0; i < num_datasets; ++i)
+            close_dataset(static_cast<sofaChoices>(i));
+
+        current_samplerate = samplerate;
     }
-    
-    int err;
-    sofa_measured = std::make_unique<MYSOFA_EASY*>(mysofa_open_data(sofaBinary, sofaSizeBinary, static_cast<float>(samplerate), &ir_length_measured, &err));
-    switch (err) 
+
+    open_dataset(activeChoice);
+}
+
+void SofaReader::set_processing(const HRIRProcessing& newProcessing)
+{
+    if (newProcessing == processing)
+        return;
+
+    for (int i = 0; i < num_datasets; ++i)
+        close_dataset(static_cast<sofaChoices>(i));
+
+    processing = newProcessing;
+}
+
+void SofaReader::set_external_file(const juce::File& file)
+{
+    const auto time = file.getLastModificationTime();
+    const auto size = file.getSize();
+
+    if (file == external_file && time == external_file_time && size == external_file_size)
+        return;
+
+    close_dataset(sofaChoices::external);
+    external_file = file;
+    external_file_time = time;
+    external_file_size = size;
+}
+
+juce::File SofaReader::get_cache_file( sofaChoices sofaChoice ) const {
+    juce::String name;
+
+    switch(sofaChoice)
     {
-        case MYSOFA_OK:
-            std::cout << "Successfully loaded Sofa File" << std::endl;
-            std::cout << "Length of IRs: " << ir_length_measured << std::endl;
+        case sofaChoices::external:
+            // a changed file on the same path gets a new cache file
+            name = "external_" + juce::String::toHexString((external_file.getFullPathName()
+                                                            + juce::String(external_file_time.toMilliseconds())
+                                                            + juce::String(external_file_size)).hashCode64());
+            break;
+
+        case sofaChoices::interpolated_sh:
+            name = "interpolated_sh";
             break;
+
+        case sofaChoices::interpolated_sh_timealign:
+            name = "interpolated_sh_timealign";
+            break;
+
+        case sofaChoices::interpolated_mca:
+            name = "interpolated_mca";
+            break;
+
+        case sofaChoices::measured:
         default:
-            std::cout << "Error while loading Sofa File" << std::endl;
-            return;
+            name = "measured";
+            break;
     }
-            
-    // INTERPOLATED SH
-    sofaBinary = BinaryData::pp2_HRIRs_interpolated_sh_time_aligned_sofa;
-    sofaSizeBinary = BinaryData::pp2_HRIRs_interpolated_sh_time_aligned_sofaSize;
-    
-    if (sofa_interpolated_sh != nullptr)
+
+    return juce::File::getSpecialLocation(juce::File::userApplicationDataDirectory)
+        .getChildFile("Orbe")
+        .getChildFile("HRIRCache")
+        .getChildFile(name + "_" + juce::String(juce::roundToInt(current_samplerate)) + processing.getCacheSuffix() + ".hrirs");
+}
+
+juce::int64 SofaReader::get_source_key( sofaChoices sofaChoice, const char* data, juce::int64 size ) const {
+    // an external file isn't read for this, it changed if its time or size did
+    if (sofaChoice == sofaChoices::external)
+        return (juce::String(external_file_time.toMilliseconds()) + "_" + juce::String(size)).hashCode64();
+
+    // the embedded files change with a new build, fnv-1a over their content
+    auto hash = static_cast<juce::uint64>(14695981039346656037ull);
+
+    for (juce::int64 i = 0; i < size; ++i)
     {
-        sofa_interpolated_sh.reset();
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 1099511628211ull;
     }
-    
-    err;
-    sofa_interpolated_sh = std::make_unique<MYSOFA_EASY*>(mysofa_open_data(sofaBinary, sofaSizeBinary, static_cast<float>(samplerate), &ir_length_interpolated_sh, &err));
-    switch (err) 
+
+    return static_cast<juce::int64>(hash);
+}
+
+bool SofaReader::open_dataset( sofaChoices sofaChoice ) {
+    auto& dataset = datasets[static_cast<size_t>(sofaChoice)];
+
+    if (dataset.hrirs != nullptr)
+        return true;
+
+    if (dataset.failed)
+        return false;
+
+    // another instance may have the same dataset open already
+    dataset.hrirs = registry->getOrCreate(get_cache_file(sofaChoice).getFullPathName(), [&] { return load_dataset(sofaChoice); });
+
+    if (dataset.hrirs == nullptr)
     {
-        case MYSOFA_OK:
-            std::cout << "Successfully loaded Sofa File" << std::endl;
-            std::cout << "Length of IRs: " << ir_length_interpolated_sh << std::endl;
+        dataset.failed = true;
+        return false;
+    }
+
+    dataset.last_used = juce::Time::getMillisecondCounter();
+    return true;
+}
+
+std::shared_ptr<const HRIRSet> SofaReader::load_dataset( sofaChoices sofaChoice ) {
+    const char* sofaBinary = nullptr;
+    juce::int64 sofaSizeBinary = 0;
+
+    switch(sofaChoice)
+    {
+        case sofaChoices::external:
+            if (! external_file.existsAsFile())
+                return nullptr;
+
+            // only mapped if the cache can't be used, see below
+            sofaSizeBinary = external_file.getSize();
             break;
+
+        case sofaChoices::interpolated_sh:
+            sofaBinary = BinaryData::pp2_HRIRs_interpolated_sh_time_aligned_sofa;
+            sofaSizeBinary = BinaryData::pp2_HRIRs_interpolated_sh_time_aligned_sofaSize;
+            break;
+
+        case sofaChoices::interpolated_sh_timealign:
+            sofaBinary = BinaryData::pp2_HRIRs_interpolated_sh_timealign_time_aligned_sofa;
+            sofaSizeBinary = BinaryData::pp2_HRIRs_interpolated_sh_timealign_time_aligned_sofaSize;
+            break;
+
+        case sofaChoices::interpolated_mca:
+            sofaBinary = BinaryData::pp2_HRIRs_interpolated_mca_time_aligned_sofa;
+            sofaSizeBinary = BinaryData::pp2_HRIRs_interpolated_mca_time_aligned_sofaSize;
+            break;
+
+        case sofaChoices::measured:
         default:
-            std::cout << "Error while loading Sofa File" << std::endl;
-            return;
+            sofaBinary = BinaryData::pp2_HRIRs_measured_time_aligned_sofa;
+            sofaSizeBinary = BinaryData::pp2_HRIRs_measured_time_aligned_sofaSize;
+            break;
+    }
+
+    // a cache file from an earlier run only needs to be mapped, no resampling involved
+    const auto sourceKey = get_source_key(sofaChoice, sofaBinary, sofaSizeBinary);
+    auto cacheFile = get_cache_file(sofaChoice);
+    if (auto cached = HRIRSet::loadFromCacheFile(cacheFile, current_samplerate, sourceKey))
+        return cached;
+
+    // external files are parsed straight from the mapped pages, without reading them into memory first
+    std::unique_ptr<juce::MemoryMappedFile> mappedSofa;
+
+    if (sofaChoice == sofaChoices::external)
+    {
+        mappedSofa = std::make_unique<juce::MemoryMappedFile>(external_file, juce::MemoryMappedFile::readOnly);
+        sofaBinary = static_cast<const char*>(mappedSofa->getData());
+
+        if (sofaBinary == nullptr || static_cast<juce::int64>(mappedSofa->getSize()) != sofaSizeBinary)
+        {
+            DBG("Could not map Sofa File " << external_file.getFullPathName());
+            return nullptr;
+        }
     }
-            
-    // INTERPOLATED SH TIMEALIGNED
-    sofaBinary = BinaryData::pp2_HRIRs_interpolated_sh_timealign_time_aligned_sofa;
-    sofaSizeBinary = BinaryData::pp2_HRIRs_interpolated_sh_timealign_time_aligned_sofaSize;
-    
-    if (sofa_interpolated_sh_timealign != nullptr)
+
+    // only parse the file here, resampling and normalisation run in parallel in HRIRSet
+    int err;
+    auto hrtf = mysofa_load_data(sofaBinary, static_cast<long>(sofaSizeBinary), &err);
+    mappedSofa.reset();
+
+    if (hrtf != nullptr && err == MYSOFA_OK)
+        err = mysofa_check(hrtf);
+
+    if (hrtf == nullptr || err != MYSOFA_OK || hrtf->R != 2)
     {
-        sofa_interpolated_sh_timealign.reset();
+        DBG("Error while loading Sofa File");
+        if (hrtf != nullptr)
+            mysofa_free(hrtf);
+        return nullptr;
     }
-    
-    err;
-    sofa_interpolated_sh_timealign = std::make_unique<MYSOFA_EASY*>(mysofa_open_data(sofaBinary, sofaSizeBinary, static_cast<float>(samplerate), &ir_length_interpolated_sh_timealign, &err));
-    switch (err) 
+
+    mysofa_tocartesian(hrtf);
+
+    std::shared_ptr<const HRIRSet> hrirs = HRIRSet::createFromSofa(hrtf, current_samplerate, sourceKey, processing, workers->getIngestionPool());
+    mysofa_free(hrtf);
+
+    // prefer the mapped file, so all instances share the same pages
+    if (hrirs->writeToCacheFile(cacheFile))
     {
-        case MYSOFA_OK:
-            std::cout << "Successfully loaded Sofa File" << std::endl;
-            std::cout << "Length of IRs: " << ir_length_interpolated_sh_timealign << std::endl;
-            break;
-        default:
-            std::cout << "Error while loading Sofa File" << std::endl;
-            return;
+        if (auto mapped = HRIRSet::loadFromCacheFile(cacheFile, current_samplerate, sourceKey))
+            hrirs = std::move(mapped);
     }
-            
-    // INTERPOLATED SH TIMEALIGNED
-    sofaBinary = BinaryData::pp2_HRIRs_interpolated_mca_time_aligned_sofa;
-    sofaSizeBinary = BinaryData::pp2_HRIRs_interpolated_mca_time_aligned_sofaSize;
-    
-    if (sofa_interpolated_mca != nullptr)
+    else
     {
-        sofa_interpolated_mca.reset();
+        DBG("Could not write Sofa cache file " << cacheFile.getFullPathName());
     }
-    
-    err;
-    sofa_interpolated_mca = std::make_unique<MYSOFA_EASY*>(mysofa_open_data(sofaBinary, sofaSizeBinary, static_cast<float>(samplerate), &ir_length_interpolated_mca, &err));
-    switch (err) 
+
+    return hrirs;
+}
+
+void SofaReader::close_dataset( sofaChoices sofaChoice ) {
+    auto& dataset = datasets[static_cast<size_t>(sofaChoice)];
+    dataset.hrirs.reset();
+    dataset.failed = false;
+}
+
+void SofaReader::release_unused(sofaChoices activeChoice, juce::uint32 timeoutMs) {
+    const auto now = juce::Time::getMillisecondCounter();
+
+    for (int i = 0; i < num_datasets; ++i)
     {
-        case MYSOFA_OK:
-            std::cout << "Successfully loaded Sofa File" << std::endl;
-            std::cout << "Length of IRs: " << ir_length_interpolated_mca << std::endl;
-            break;
-        default:
-            std::cout << "Error while loading Sofa File" << std::endl;
-            return;
+        const auto& dataset = datasets[static_cast<size_t>(i)];
+
+        if (i != static_cast<int>(activeChoice) && dataset.hrirs != nullptr && now - dataset.last_used > timeoutMs)
+            close_dataset(static_cast<sofaChoices>(i));
     }
 }
 
+const HRIRSet* SofaReader::get_hrir_set( sofaChoices sofaChoice ) {
+    // opens the dataset on first use, this runs on the loader thread
+    if (! open_dataset(sofaChoice))
+        return nullptr;
+
+    auto& dataset = datasets[static_cast<size_t>(sofaChoice)];
+    dataset.last_used = juce::Time::getMillisecondCounter();
+    return dataset.hrirs.get();
+}
+
 int SofaReader::get_ir_length( sofaChoices sofaChoice ) {
-    switch(sofaChoice)
+    auto hrirs = get_hrir_set(sofaChoice);
+    return hrirs != nullptr ? hrirs->getIRLength() : 0;
+}
+
+void SofaReader::get_hrirs(AudioBuffer<float> &buffer, float azim, float elev, float dist, float &leftDelay, float &rightDelay, sofaChoices sofaChoice, bool doNearestNeighbourInterpolation, interpolationEngines interpolationEngine) {
+    juce::ignoreUnused(dist);
+
+    auto hrirs = get_hrir_set(sofaChoice);
+    if (hrirs == nullptr)
+        return;
+
+    // neighbours and weights come straight from the direction grid, no search involved
+    auto cell = hrirs->lookupDirection(azim, elev);
+    const auto numSamples = hrirs->getIRLength();
+
+    // or from the triangle around the direction, if the dataset could be triangulated
+    if ( doNearestNeighbourInterpolation && interpolationEngine == interpolationEngines::barycentric )
     {
-        case sofaChoices::measured:
-            return ir_length_measured;
-            
-        case sofaChoices::interpolated_sh:
-            return ir_length_interpolated_sh;
-            
-        case sofaChoices::interpolated_sh_timealign:
-            return ir_length_interpolated_sh_timealign;
-            
-        case sofaChoices::interpolated_mca:
-            return ir_length_interpolated_mca;
-            
-        default:
-            return ir_length_measured;
+        int indices[3];
+        float weights[3];
+
+        if (hrirs->getTriangulation().lookup(azim, elev, indices, weights))
+        {
+            for (int i = 0; i < HRIRSet::numNeighbours; ++i)
+            {
+                cell.indices[i] = indices[i];
+                cell.weights[i] = weights[i];
+            }
+        }
+    }
+
+    if ( ! doNearestNeighbourInterpolation )
+    {
+        buffer.copyFrom(0, 0, hrirs->getIR(cell.indices[0], 0), numSamples);
+        buffer.copyFrom(1, 0, hrirs->getIR(cell.indices[0], 1), numSamples);
+        leftDelay = hrirs->getDelay(cell.indices[0], 0);
+        rightDelay = hrirs->getDelay(cell.indices[0], 1);
+        return;
+    }
+
+    buffer.clear();
+    leftDelay = 0.0f;
+    rightDelay = 0.0f;
+
+    for (int i = 0; i < HRIRSet::numNeighbours; ++i)
+    {
+        const auto weight = cell.weights[i];
+        if (weight <= 0.0f)
+            continue;
+
+        juce::FloatVectorOperations::addWithMultiply(buffer.getWritePointer(0), hrirs->getIR(cell.indices[i], 0), weight, numSamples);
+        juce::FloatVectorOperations::addWithMultiply(buffer.getWritePointer(1), hrirs->getIR(cell.indices[i], 1), weight, numSamples);
+        leftDelay += weight * hrirs->getDelay(cell.indices[i], 0);
+        rightDelay += weight * hrirs->getDelay(cell.indices[i], 1);
     }
 }
 
-void SofaReader::get_hrirs(AudioBuffer<float> &buffer, float azim, float elev, float dist, float &leftDelay, float &rightDelay, sofaChoices sofaChoice, bool doNearestNeighbourInterpolation) {
-    auto leftIR = buffer.getWritePointer(0);
-    auto rightIR = buffer.getWritePointer(1);
-    //float leftDelay;
-    //float rightDelay;
-    // convert coordinates to xyz
-    coordinate_buffer[0] = azim;
-    coordinate_buffer[1] = elev;
-    coordinate_buffer[2] = dist;
-    mysofa_s2c((float *) &coordinate_buffer);
-    
-    switch(sofaChoice)
+int SofaReader::get_num_measurements( sofaChoices sofaChoice ) {
+    auto hrirs = get_hrir_set(sofaChoice);
+    return hrirs != nullptr ? hrirs->getNumMeasurements() : 0;
+}
+
+float SofaReader::get_grid_spacing( sofaChoices sofaChoice ) {
+    auto hrirs = get_hrir_set(sofaChoice);
+    return hrirs != nullptr ? hrirs->getGridSpacing() : 0.0f;
+}
+
+void SofaReader::get_measurement_hrirs(AudioBuffer<float> &buffer, std::vector<float> &delays, sofaChoices sofaChoice) {
+    // buffer gets 2 channels (left, right) per measurement, delays gets 2 values per measurement
+    auto hrirs = get_hrir_set(sofaChoice);
+    auto numMeasurements = get_num_measurements(sofaChoice);
+
+    buffer.setSize(2 * numMeasurements, get_ir_length(sofaChoice));
+    delays.resize(static_cast<size_t>(2 * numMeasurements));
+
+    for (int i = 0; i < numMeasurements; ++i)
     {
-        case sofaChoices::measured:
-            if ( doNearestNeighbourInterpolation )
-                mysofa_getfilter_float(*sofa_measured, coordinate_buffer[0], coordinate_buffer[1], coordinate_buffer[2], leftIR, rightIR, &leftDelay, &rightDelay);
-            else
-                mysofa_getfilter_float_nointerp(*sofa_measured, coordinate_buffer[0], coordinate_buffer[1], coordinate_buffer[2], leftIR, rightIR, &leftDelay, &rightDelay);
-            break;
-            
-        case sofaChoices::interpolated_sh:
-            if ( doNearestNeighbourInterpolation )
-                mysofa_getfilter_float(*sofa_interpolated_sh, coordinate_buffer[0], coordinate_buffer[1], coordinate_buffer[2], leftIR, rightIR, &leftDelay, &rightDelay);
-            else
-                mysofa_getfilter_float_nointerp(*sofa_interpolated_sh, coordinate_buffer[0], coordinate_buffer[1], coordinate_buffer[2], leftIR, rightIR, &leftDelay, &rightDelay);
-            break;
-            
-        case sofaChoices::interpolated_sh_timealign:
-            if ( doNearestNeighbourInterpolation )
-                mysofa_getfilter_float(*sofa_interpolated_sh_timealign, coordinate_buffer[0], coordinate_buffer[1], coordinate_buffer[2], leftIR, rightIR, &leftDelay, &rightDelay);
-            else
-                mysofa_getfilter_float_nointerp(*sofa_interpolated_sh_timealign, coordinate_buffer[0], coordinate_buffer[1], coordinate_buffer[2], leftIR, rightIR, &leftDelay, &rightDelay);
-            break;
-            
-        case sofaChoices::interpolated_mca:
-            if ( doNearestNeighbourInterpolation )
-                mysofa_getfilter_float(*sofa_interpolated_mca, coordinate_buffer[0], coordinate_buffer[1], coordinate_buffer[2], leftIR, rightIR, &leftDelay, &rightDelay);
-            else
-                mysofa_getfilter_float_nointerp(*sofa_interpolated_mca, coordinate_buffer[0], coordinate_buffer[1], coordinate_buffer[2], leftIR, rightIR, &leftDelay, &rightDelay);
-            break;
-            
-        default:
-            if ( doNearestNeighbourInterpolation )
-                mysofa_getfilter_float(*sofa_measured, coordinate_buffer[0], coordinate_buffer[1], coordinate_buffer[2], leftIR, rightIR, &leftDelay, &rightDelay);
-            else
-                mysofa_getfilter_float_nointerp(*sofa_interpolated_mca, coordinate_buffer[0], coordinate_buffer[1], coordinate_buffer[2], leftIR, rightIR, &leftDelay, &rightDelay);
-            break;
+        for (int ear = 0; ear < 2; ++ear)
+        {
+            buffer.copyFrom(2 * i + ear, 0, hrirs->getIR(i, ear), hrirs->getIRLength());
+            delays[static_cast<size_t>(2 * i + ear)] = hrirs->getDelay(i, ear);
+        }
     }
 }
+
+std::shared_ptr<const HRIRSet> SofaReader::get_shared_hrir_set( sofaChoices sofaChoice ) {
+    if (get_hrir_set(sofaChoice) == nullptr)
+        return nullptr;
+
+    return datasets[static_cast<size_t>(sofaChoice)].hrirs;
+}
+
+int SofaReader::get_nearest_measurement(float azim, float elev, float dist, sofaChoices sofaChoice) {
+    juce::ignoreUnused(dist);
+
+    auto hrirs = get_hrir_set(sofaChoice);
+    if (hrirs == nullptr)
+        return 0;
+
+    return hrirs->lookupDirection(azim, elev).indices[0];
+}
@@ -7,13 +7,24 @@
 
 #include <JuceHeader.h>
 #include <mysofa.h>
+#include "HRIRSet.h"
+#include "HRIRSetRegistry.h"
+#include "HRIRWorkerPool.h"
 
 enum sofaChoices
 {
     measured,
     interpolated_sh,
     interpolated_sh_timealign,
-    interpolated_mca
+    interpolated_mca,
+    // a sofa file on disk, see set_external_file
+    external
+};
+
+enum interpolationEngines
+{
+    inverse_distance,
+    barycentric
 };
 
 class SofaReader {
@@ -21,24 +32,62 @@ public:
     SofaReader() = default;
     ~SofaReader();
 
-    void prepare(double samplerate);
+    // only opens the active dataset, the others are opened on first use
+    void prepare(double samplerate, sofaChoices activeChoice);
+    // file used for sofaChoices::external, it is memory-mapped and parsed on first use.
+    // The same path is opened again if the file changed on disk since.
+    void set_external_file(const juce::File& file);
+    // changing the processing closes every dataset, they are reopened on first use
+    void set_processing(const HRIRProcessing& newProcessing);
 
     int get_ir_length( sofaChoices sofaChoice) ;
-    void get_hrirs(juce::AudioBuffer<float>& buffer, float azim, float elev, float dist, float &currentLeftDelay, float &currentRightDelay, sofaChoices sofaChoice, bool doNearestNeighbourInterpolation);
+    void get_hrirs(juce::AudioBuffer<float>& buffer, float azim, float elev, float dist, float &currentLeftDelay, float &currentRightDelay, sofaChoices sofaChoice, bool doNearestNeighbourInterpolation, interpolationEngines interpolationEngine = interpolationEngines::inverse_distance);
+
+    // access to the raw measurement grid, used to build a precomputed hrtf bank
+    int get_num_measurements( sofaChoices sofaChoice );
+    float get_grid_spacing( sofaChoices sofaChoice );
+    void get_measurement_hrirs(juce::AudioBuffer<float>& buffer, std::vector<float>& delays, sofaChoices sofaChoice);
+    int get_nearest_measurement(float azim, float elev, float dist, sofaChoices sofaChoice);
+    // keeps the dataset alive for users on other threads, e.g. barycentric lookups on the audio thread
+    std::shared_ptr<const HRIRSet> get_shared_hrir_set( sofaChoices sofaChoice );
+
+    // closes every dataset except activeChoice that was not used within timeoutMs
+    void release_unused(sofaChoices activeChoice, juce::uint32 timeoutMs);
 
 private:
-    
-    float coordinate_buffer[3];
-    
-    int ir_length_measured;
-    int ir_length_interpolated_sh;
-    int ir_length_interpolated_sh_timealign;
-    int ir_length_interpolated_mca;
-    //std::map<juce::String interpolation, std::unique_ptr<MYSOFA_EASY*> sofa_files;
-    std::unique_ptr<MYSOFA_EASY*> sofa_measured;
-    std::unique_ptr<MYSOFA_EASY*> sofa_interpolated_sh;
-    std::unique_ptr<MYSOFA_EASY*> sofa_interpolated_sh_timealign;
-    std::unique_ptr<MYSOFA_EASY*> sofa_interpolated_mca;
+    struct SofaDataset
+    {
+        std::shared_ptr<const HRIRSet> hrirs;
+        juce::uint32 last_used = 0;
+        // set when the file could not be opened, so it isn't parsed again on every job
+        bool failed = false;
+    };
+
+    static constexpr int num_datasets = 5;
+
+    const HRIRSet* get_hrir_set( sofaChoices sofaChoice );
+    bool open_dataset( sofaChoices sofaChoice );
+    std::shared_ptr<const HRIRSet> load_dataset( sofaChoices sofaChoice );
+    juce::File get_cache_file( sofaChoices sofaChoice ) const;
+    // stored in the cache file, a set cached from other sofa data is built again
+    juce::int64 get_source_key( sofaChoices sofaChoice, const char* data, juce::int64 size ) const;
+    void close_dataset( sofaChoices sofaChoice );
+
+    double current_samplerate = 0.0;
+    juce::File external_file;
+    // when the external file was opened, to notice edits on disk
+    juce::Time external_file_time;
+    juce::int64 external_file_size = 0;
+    HRIRProcessing processing;
+
+    // datasets are shared with the other instances of the plugin
+    juce::SharedResourcePointer<HRIRSetRegistry> registry;
+
+    // measurements of a dataset are resampled and processed on all cores, the
+    // threads are shared with the other instances
+    juce::SharedResourcePointer<HRIRWorkerPool> workers;
+
+    std::array<SofaDataset, num_datasets> datasets;
 };
 
 #endif //BINAURALPANNER_SOFAREADER_H
@@ -0,0 +1,346 @@
+#include "SphericalTriangulation.h"
+
+namespace
+{
+    struct Vector3
+    {
+        double x, y, z;
+
+        Vector3 operator- (const Vector3& other) const { return { x - other.x, y - other.y, z - other.z }; }
+        Vector3 operator+ (const Vector3& other) const { return { x + other.x, y + other.y, z + other.z }; }
+        Vector3 operator* (double factor) const { return { x * factor, y * factor, z * factor }; }
+
+        double dot(const Vector3& other) const { return x * other.x + y * other.y + z * other.z; }
+        Vector3 cross(const Vector3& other) const { return { y * other.z - z * other.y, z * other.x - x * other.z, x * other.y - y * other.x }; }
+        double length() const { return std::sqrt(dot(*this)); }
+
+        Vector3 normalised() const
+        {
+            const auto l = length();
+            return l > 0.0 ? *this * (1.0 / l) : *this;
+        }
+    };
+
+    Vector3 getPoint(const float* positions, int index)
+    {
+        const auto p = positions + 3 * static_cast<size_t>(index);
+        return { p[0], p[1], p[2] };
+    }
+
+    // same convention as mysofa_s2c: azimuth counter clockwise from the front, elevation up
+    Vector3 getDirection(double azimuth, double elevation)
+    {
+        const auto a = juce::degreesToRadians(azimuth);
+        const auto e = juce::degreesToRadians(elevation);
+        return { std::cos(e) * std::cos(a), std::cos(e) * std::sin(a), std::sin(e) };
+    }
+
+    double getAngle(const Vector3& a, const Vector3& b)
+    {
+        return std::acos(juce::jlimit(-1.0, 1.0, a.dot(b)));
+    }
+}
+
+bool SphericalTriangulation::build(const float* positionsIn, int numPositionsIn) {
+    positions = positionsIn;
+    numPositions = numPositionsIn;
+    triangles.clear();
+    cellStart.clear();
+    cellTriangles.clear();
+
+    if (numPositions < 4)
+        return false;
+
+    // initial tetrahedron from four points that span a volume
+    const auto p0 = getPoint(positions, 0);
+    int i1 = -1, i2 = -1, i3 = -1;
+    double best = 1.0e-12;
+
+    for (int i = 1; i < numPositions; ++i)
+    {
+        const auto distance = (getPoint(positions, i) - p0).length();
+        if (distance > best) { best = distance; i1 = i; }
+    }
+
+    if (i1 < 0)
+        return false;
+
+    const auto p1 = getPoint(positions, i1);
+    best = 1.0e-12;
+
+    for (int i = 1; i < numPositions; ++i)
+    {
+        const auto area = (getPoint(positions, i) - p0).cross(p1 - p0).length();
+        if (area > best) { best = area; i2 = i; }
+    }
+
+    if (i2 < 0)
+        return false;
+
+    const auto baseNormal = (p1 - p0).cross(getPoint(positions, i2) - p0).normalised();
+    best = 1.0e-9;
+
+    for (int i = 1; i < numPositions; ++i)
+    {
+        const auto height = std::abs(baseNormal.dot(getPoint(positions, i) - p0));
+        if (height > best) { best = height; i3 = i; }
+    }
+
+    // all points in one plane, e.g. a horizontal-only dataset
+    if (i3 < 0)
+        return false;
+
+    // stays inside the hull while it grows, used to orient every face outwards
+    const auto interior = (p0 + p1 + getPoint(positions, i2) + getPoint(positions, i3)) * 0.25;
+
+    struct Face
+    {
+        int a, b, c;
+        Vector3 normal;
+        double offset;
+        bool alive;
+    };
+
+    std::vector<Face> faces;
+
+    const auto addFace = [&] (int a, int b, int c)
+    {
+        auto normal = (getPoint(positions, b) - getPoint(positions, a)).cross(getPoint(positions, c) - getPoint(positions, a)).normalised();
+
+        if (normal.dot(interior - getPoint(positions, a)) > 0.0)
+        {
+            std::swap(b, c);
+            normal = normal * -1.0;
+        }
+
+        faces.push_back({ a, b, c, normal, normal.dot(getPoint(positions, a)), true });
+    };
+
+    addFace(0, i1, i2);
+    addFace(0, i1, i3);
+    addFace(0, i2, i3);
+    addFace(i1, i2, i3);
+
+    std::vector<bool> inserted(static_cast<size_t>(numPositions), false);
+    inserted[0] = inserted[static_cast<size_t>(i1)] = inserted[static_cast<size_t>(i2)] = inserted[static_cast<size_t>(i3)] = true;
+
+    std::vector<size_t> visible;
+    std::vector<std::pair<int, int>> edges;
+    size_t numDeadFaces = 0;
+
+    // incremental convex hull, points on a sphere are all hull vertices except duplicates
+    for (int i = 0; i < numPositions; ++i)
+    {
+        if (inserted[static_cast<size_t>(i)])
+            continue;
+
+        const auto point = getPoint(positions, i);
+
+        visible.clear();
+        for (size_t f = 0; f < faces.size(); ++f)
+            if (faces[f].alive && faces[f].normal.dot(point) - faces[f].offset > 1.0e-10)
+                visible.push_back(f);
+
+        // inside the hull, this is a duplicate direction
+        if (visible.empty())
+            continue;
+
+        edges.clear();
+        for (auto f : visible)
+        {
+            edges.emplace_back(faces[f].a, faces[f].b);
+            edges.emplace_back(faces[f].b, faces[f].c);
+            edges.emplace_back(faces[f].c, faces[f].a);
+            faces[f].alive = false;
+        }
+
+        numDeadFaces += visible.size();
+
+        // the horizon consists of the edges whose opposite face stays
+        for (const auto& edge : edges)
+        {
+            const auto isShared = std::find(edges.begin(), edges.end(), std::make_pair(edge.second, edge.first)) != edges.end();
+
+            if (! isShared)
+                addFace(edge.first, edge.second, i);
+        }
+
+        if (numDeadFaces > faces.size() / 2)
+        {
+            faces.erase(std::remove_if(faces.begin(), faces.end(), [] (const Face& face) { return ! face.alive; }), faces.end());
+            numDeadFaces = 0;
+        }
+    }
+
+    for (const auto& face : faces)
+    {
+        if (! face.alive)
+            continue;
+
+        triangles.push_back(face.a);
+        triangles.push_back(face.b);
+        triangles.push_back(face.c);
+    }
+
+    buildSpatialHash();
+    return true;
+}
+
+void SphericalTriangulation::buildSpatialHash() {
+    const auto numTriangles = getNumTriangles();
+
+    // bounding cap of every triangle
+    std::vector<Vector3> triangleCentres(static_cast<size_t>(numTriangles));
+    std::vector<double> triangleRadii(static_cast<size_t>(numTriangles));
+
+    for (int t = 0; t < numTriangles; ++t)
+    {
+        const auto a = getPoint(positions, triangles[static_cast<size_t>(3 * t)]);
+        const auto b = getPoint(positions, triangles[static_cast<size_t>(3 * t + 1)]);
+        const auto c = getPoint(positions, triangles[static_cast<size_t>(3 * t + 2)]);
+        const auto centre = (a + b + c).normalised();
+
+        triangleCentres[static_cast<size_t>(t)] = centre;
+        triangleRadii[static_cast<size_t>(t)] = juce::jmax(getAngle(centre, a), getAngle(centre, b), getAngle(centre, c));
+    }
+
+    const auto numCells = hashAzimuthCells * hashElevationCells;
+    std::vector<std::vector<juce::int32>> cells(static_cast<size_t>(numCells));
+
+    for (int row = 0; row < hashElevationCells; ++row)
+    {
+        for (int column = 0; column < hashAzimuthCells; ++column)
+        {
+            const auto azimuth = -180.0 + column * hashCellSize;
+            const auto elevation = -90.0 + row * hashCellSize;
+            const auto centre = getDirection(azimuth + 0.5 * hashCellSize, elevation + 0.5 * hashCellSize);
+
+            // bounding cap of the cell, from its corners and edge midpoints plus some margin
+            double radius = 0.0;
+            for (int u = 0; u <= 2; ++u)
+                for (int v = 0; v <= 2; ++v)
+                    radius = juce::jmax(radius, getAngle(centre, getDirection(azimuth + 0.5 * u * hashCellSize, elevation + 0.5 * v * hashCellSize)));
+
+            radius += 0.01;
+
+            auto& cell = cells[static_cast<size_t>(row * hashAzimuthCells + column)];
+
+            // two caps overlap if the angle between their centres is below the sum of their radii
+            for (int t = 0; t < numTriangles; ++t)
+            {
+                const auto sumOfRadii = radius + triangleRadii[static_cast<size_t>(t)];
+
+                if (sumOfRadii >= juce::MathConstants<double>::pi
+                    || centre.dot(triangleCentres[static_cast<size_t>(t)]) >= std::cos(sumOfRadii))
+                    cell.push_back(t);
+            }
+        }
+    }
+
+    cellStart.assign(1, 0);
+    for (const auto& cell : cells)
+    {
+        cellTriangles.insert(cellTriangles.end(), cell.begin(), cell.end());
+        cellStart.push_back(static_cast<juce::int32>(cellTriangles.size()));
+    }
+}
+
+void SphericalTriangulation::serialise(std::vector<juce::int32>& data) const {
+    data.clear();
+    data.push_back(static_cast<juce::int32>(triangles.size()));
+    data.push_back(static_cast<juce::int32>(cellStart.size()));
+    data.push_back(static_cast<juce::int32>(cellTriangles.size()));
+    data.insert(data.end(), triangles.begin(), triangles.end());
+    data.insert(data.end(), cellStart.begin(), cellStart.end());
+    data.insert(data.end(), cellTriangles.begin(), cellTriangles.end());
+}
+
+bool SphericalTriangulation::restore(const float* positionsIn, int numPositionsIn, const juce::int32* data, size_t size) {
+    positions = positionsIn;
+    numPositions = numPositionsIn;
+    triangles.clear();
+    cellStart.clear();
+    cellTriangles.clear();
+
+    if (size < 3)
+        return false;
+
+    const auto numTriangleIndices = static_cast<size_t>(data[0]);
+    const auto numCellStarts = static_cast<size_t>(data[1]);
+    const auto numCellTriangles = static_cast<size_t>(data[2]);
+
+    if (size != 3 + numTriangleIndices + numCellStarts + numCellTriangles
+        || numCellStarts != static_cast<size_t>(hashAzimuthCells * hashElevationCells + 1))
+        return false;
+
+    auto read = data + 3;
+    triangles.assign(read, read + numTriangleIndices);
+    read += numTriangleIndices;
+    cellStart.assign(read, read + numCellStarts);
+    read += numCellStarts;
+    cellTriangles.assign(read, read + numCellTriangles);
+
+    return true;
+}
+
+bool SphericalTriangulation::lookup(float azimuth, float elevation, int* indices, float* weights) const noexcept {
+    if (! isValid())
+        return false;
+
+    auto column = static_cast<int>(std::floor((azimuth + 180.0f) / hashCellSize)) % hashAzimuthCells;
+    if (column < 0)
+        column += hashAzimuthCells;
+
+    const auto row = juce::jlimit(0, hashElevationCells - 1, static_cast<int>(std::floor((elevation + 90.0f) / hashCellSize)));
+    const auto cell = static_cast<size_t>(row * hashAzimuthCells + column);
+
+    const auto direction = getDirection(azimuth, elevation);
+
+    int bestTriangle = -1;
+    double bestMinimum = std::numeric_limits<double>::lowest();
+    double bestWeights[3] = {};
+
+    for (auto i = cellStart[cell]; i < cellStart[cell + 1]; ++i)
+    {
+        const auto t = static_cast<size_t>(cellTriangles[static_cast<size_t>(i)]);
+        const auto a = getPoint(positions, triangles[3 * t]);
+        const auto b = getPoint(positions, triangles[3 * t + 1]);
+        const auto c = getPoint(positions, triangles[3 * t + 2]);
+
+        // unnormalised barycentric coordinates of the ray through the triangle's plane
+        const double w[3] = { direction.dot(b.cross(c)), direction.dot(c.cross(a)), direction.dot(a.cross(b)) };
+        const auto minimum = juce::jmin(w[0], w[1], w[2]);
+
+        if (minimum > bestMinimum)
+        {
+            bestMinimum = minimum;
+            bestTriangle = static_cast<int>(t);
+            std::copy(w, w + 3, bestWeights);
+
+            if (minimum >= -1.0e-9)
+                break;
+        }
+    }
+
+    if (bestTriangle < 0)
+        return false;
+
+    // numerical misses right on an edge are clamped onto the closest triangle
+    double sum = 0.0;
+    for (auto& w : bestWeights)
+    {
+        w = juce::jmax(0.0, w);
+        sum += w;
+    }
+
+    if (sum <= 0.0)
+        return false;
+
+    for (int i = 0; i < 3; ++i)
+    {
+        indices[i] = triangles[3 * static_cast<size_t>(bestTriangle) + static_cast<size_t>(i)];
+        weights[i] = static_cast<float>(bestWeights[i] / sum);
+    }
+
+    return true;
+}
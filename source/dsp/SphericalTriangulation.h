@@ -0,0 +1,44 @@
+#ifndef BINAURALPANNER_SPHERICALTRIANGULATION_H
+#define BINAURALPANNER_SPHERICALTRIANGULATION_H
+
+#include <JuceHeader.h>
+
+// Delaunay triangulation of measurement directions on the unit sphere (the convex
+// hull of the points), with a spatial hash over azimuth and elevation, so the
+// triangle around a direction is found without searching all triangles.
+class SphericalTriangulation {
+public:
+    // triangulates numPositions unit vectors (x, y, z interleaved), which must
+    // outlive this object. Returns false if the points don't span a volume.
+    bool build(const float* positions, int numPositions);
+
+    // flat representation, used to store the triangulation in the hrir cache file
+    void serialise(std::vector<juce::int32>& data) const;
+    bool restore(const float* positions, int numPositions, const juce::int32* data, size_t size);
+
+    bool isValid() const { return ! triangles.empty(); }
+    int getNumTriangles() const { return static_cast<int>(triangles.size() / 3); }
+
+    // finds the triangle around a direction (angles in degrees) and its barycentric
+    // weights. Doesn't allocate, so it is safe to call on the audio thread.
+    bool lookup(float azimuth, float elevation, int* indices, float* weights) const noexcept;
+
+private:
+    void buildSpatialHash();
+
+    // 5 degree cells, azimuth -180..179 and elevation -90..90
+    static constexpr int hashAzimuthCells = 72;
+    static constexpr int hashElevationCells = 36;
+    static constexpr float hashCellSize = 5.0f;
+
+    const float* positions = nullptr;
+    int numPositions = 0;
+
+    // three vertex indices per triangle, counter clockwise seen from outside
+    std::vector<juce::int32> triangles;
+    // triangles overlapping each hash cell
+    std::vector<juce::int32> cellStart;
+    std::vector<juce::int32> cellTriangles;
+};
+
+#endif //BINAURALPANNER_SPHERICALTRIANGULATION_H
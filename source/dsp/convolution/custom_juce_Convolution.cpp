@@ -23,6 +23,8 @@
   ==============================================================================
 */
 #include "custom_juce_Convolution.h"
+#include "custom_juce_FFTBackend.h"
+#include "custom_juce_SpectrumProducts.h"
 
 namespace custom_juce
 {
@@ -81,14 +83,13 @@ public:
     using IncomingCommand = juce::FixedSizeFunction<400, void()>;
 
     // Push functions here, and they'll be called later on a background thread.
-    // This function is wait-free.
-    // This function is only safe to call from a single thread at a time.
-    bool push (IncomingCommand& command) { return queue.push (command); }
-
-    void popAll()
+    // This function is wait-free and may be called from several threads, e.g. by
+    // Convolutions in different plugin instances sharing the queue. If another
+    // thread is pushing at the same time, the push fails like on a full queue.
+    bool push (IncomingCommand& command)
     {
-        const ScopedLock lock (popMutex);
-        queue.popAll ([] (IncomingCommand& command) { command(); command = nullptr; });
+        const SpinLock::ScopedTryLockType lock (pushMutex);
+        return lock.isLocked() && queue.push (command);
     }
 
     using Thread::startThread;
@@ -116,6 +117,7 @@ private:
     }
 
     CriticalSection popMutex;
+    SpinLock pushMutex;
     Queue<IncomingCommand> queue;
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (BackgroundMessageQueue)
@@ -145,90 +147,312 @@ ConvolutionMessageQueue::ConvolutionMessageQueue (ConvolutionMessageQueue&&) noe
 ConvolutionMessageQueue& ConvolutionMessageQueue::operator= (ConvolutionMessageQueue&&) noexcept = default;
 
 //==============================================================================
+// Gains of the outgoing and the incoming impulse response at a point of a
+// transition, the position goes from 0 to 1.
+static void getTransitionGains (Convolution::TransitionCurve curve, float position, float& previousGain, float& currentGain) noexcept
+{
+    if (curve == Convolution::TransitionCurve::equalPower)
+    {
+        previousGain = std::cos (position * MathConstants<float>::halfPi);
+        currentGain  = std::sin (position * MathConstants<float>::halfPi);
+        return;
+    }
+
+    previousGain = 1.0f - position;
+    currentGain  = position;
+}
+
+//==============================================================================
+// Convolves one input with one or more impulse responses of the same length, e.g.
+// a mono source with the left and right HRIR. All outputs share the forward
+// transform and the frequency domain delay line of the input, only the complex
+// multiplications and the inverse transform are done per output.
 struct ConvolutionEngine
 {
-    ConvolutionEngine (const float* samples,
+    static constexpr size_t maxNumOutputs = 2;
+
+    ConvolutionEngine (const float* const* samples,
+                       size_t numOutputsIn,
+                       size_t numSamples,
+                       size_t maxBlockSize)
+        : ConvolutionEngine (numOutputsIn, numSamples, maxBlockSize)
+    {
+        for (size_t i = 0; i < numOutputs; ++i)
+            updateSegmentsIfNecessary (numSegments, outputs[i].buffersImpulseSegments, fftSize);
+
+        setImpulseResponse (samples, numSamples);
+    }
+
+    // Builds an engine which doesn't own any impulse response data, but reads the
+    // partitioned spectra from segments prepared elsewhere (see ImpulseResponseSet),
+    // one set of segments per output. Call setImpulseSegments() before processing.
+    ConvolutionEngine (const std::vector<AudioBuffer<float>>* const* sharedImpulseSegments,
+                       size_t numOutputsIn,
                        size_t numSamples,
                        size_t maxBlockSize)
-        : blockSize ((size_t) nextPowerOfTwo ((int) maxBlockSize)),
-          fftSize (blockSize > 128 ? 2 * blockSize : 4 * blockSize),
-          fftObject (std::make_unique<FFT> (roundToInt (std::log2 (fftSize)))),
-          numSegments (numSamples / (fftSize - blockSize) + 1u),
-          numInputSegments ((blockSize > 128 ? numSegments : 3 * numSegments)),
-          bufferInput      (1, static_cast<int> (fftSize)),
-          bufferOutput     (1, static_cast<int> (fftSize * 2)),
-          bufferTempOutput (1, static_cast<int> (fftSize * 2)),
-          bufferOverlap    (1, static_cast<int> (fftSize))
-    {
-        bufferOutput.clear();
-
-        auto updateSegmentsIfNecessary = [this] (size_t numSegmentsToUpdate,
-                                                 std::vector<AudioBuffer<float>>& segments)
+        : ConvolutionEngine (numOutputsIn, numSamples, maxBlockSize)
+    {
+        for (size_t i = 0; i < numOutputs; ++i)
         {
-            if (numSegmentsToUpdate == 0
-                || numSegmentsToUpdate != (size_t) segments.size()
-                || (size_t) segments[0].getNumSamples() != fftSize * 2)
-            {
-                segments.clear();
+            auto& out = outputs[i];
 
-                for (size_t i = 0; i < numSegmentsToUpdate; ++i)
-                    segments.push_back ({ 1, static_cast<int> (fftSize * 2) });
-            }
-        };
+            // Only used as the destinations of setBlendedImpulseSegments()
+            updateSegmentsIfNecessary (numSegments, out.buffersImpulseSegments, fftSize);
+            updateSegmentsIfNecessary (numSegments, out.buffersAlternateSegments, fftSize);
+
+            // Only used during transitions, see beginTransition()
+            out.bufferPreviousOutput    .setSize (1, static_cast<int> (fftSize * 2));
+            out.bufferPreviousTempOutput.setSize (1, static_cast<int> (fftSize * 2));
+            out.bufferPreviousOverlap   .setSize (1, static_cast<int> (fftSize));
 
-        updateSegmentsIfNecessary (numInputSegments, buffersInputSegments);
-        updateSegmentsIfNecessary (numSegments,      buffersImpulseSegments);
+            setImpulseSegments (*sharedImpulseSegments[i], i);
+        }
+
+        bufferTransitionGains.setSize (2, static_cast<int> (blockSize));
 
-        auto FFTTempObject = std::make_unique<FFT> (roundToInt (std::log2 (fftSize)));
+        reset();
+    }
+
+private:
+    ConvolutionEngine (size_t numOutputsIn, size_t numSamples, size_t maxBlockSize)
+        : blockSize (getBlockSize (maxBlockSize)),
+          fftSize (getFFTSize (blockSize, numSamples)),
+          fftObject (FFTBackend::getShared (roundToInt (std::log2 (fftSize)))),
+          numSegments (getNumSegments (numSamples, blockSize, fftSize)),
+          numInputSegments (numSegments * ((fftSize - blockSize) / blockSize)),
+          numOutputs (jlimit ((size_t) 1, maxNumOutputs, numOutputsIn)),
+          bufferInput (1, static_cast<int> (fftSize)),
+          inputPointers (numSegments),
+          impulsePointers (numSegments),
+          spectrumKernel (getSpectrumKernel())
+    {
+        for (size_t i = 0; i < numOutputs; ++i)
+        {
+            auto& out = outputs[i];
+            out.bufferOutput    .setSize (1, static_cast<int> (fftSize * 2));
+            out.bufferTempOutput.setSize (1, static_cast<int> (fftSize * 2));
+            out.bufferOverlap   .setSize (1, static_cast<int> (fftSize));
+            out.bufferOutput.clear();
+            out.impulseSegments = &out.buffersImpulseSegments;
+        }
+
+        updateSegmentsIfNecessary (numInputSegments, buffersInputSegments, fftSize);
+    }
+
+public:
+    static size_t getBlockSize (size_t maxBlockSize) noexcept   { return (size_t) nextPowerOfTwo ((int) maxBlockSize); }
+
+    // Picks the cheaper of the two uniform layouts for this impulse response length.
+    // Long responses need fewer partitions with the larger FFT, short ones (e.g.
+    // truncated HRIRs) fit into a few partitions of the smaller one.
+    static size_t getFFTSize (size_t blockSize, size_t numSamples) noexcept
+    {
+        if (blockSize > 128)
+            return 2 * blockSize;
+
+        return getCost (blockSize, numSamples, 2 * blockSize) <= getCost (blockSize, numSamples, 4 * blockSize) ? 2 * blockSize
+                                                                                                                 : 4 * blockSize;
+    }
+
+    // Forward and inverse transform per block, plus one complex multiply-accumulate
+    // per partition
+    static double getCost (size_t blockSize, size_t numSamples, size_t fftSize) noexcept
+    {
+        return static_cast<double> (fftSize) * std::log2 ((double) fftSize)
+             + static_cast<double> (getNumSegments (numSamples, blockSize, fftSize) * fftSize);
+    }
+
+    static size_t getNumSegments (size_t numSamples, size_t blockSize, size_t fftSize) noexcept
+    {
+        const auto segmentSize = fftSize - blockSize;
+        return jmax ((size_t) 1, (numSamples + segmentSize - 1) / segmentSize);
+    }
+
+    static void updateSegmentsIfNecessary (size_t numSegmentsToUpdate,
+                                           std::vector<AudioBuffer<float>>& segments,
+                                           size_t fftSize)
+    {
+        if (numSegmentsToUpdate == 0
+            || numSegmentsToUpdate != (size_t) segments.size()
+            || (size_t) segments[0].getNumSamples() != fftSize * 2)
+        {
+            segments.clear();
+
+            for (size_t i = 0; i < numSegmentsToUpdate; ++i)
+                segments.push_back ({ 1, static_cast<int> (fftSize * 2) });
+        }
+    }
+
+    // Partitions an impulse response and transforms every partition into the
+    // layout used by multiplyAccumulate.
+    static void prepareImpulseSegments (std::vector<AudioBuffer<float>>& segments,
+                                        const float* samples,
+                                        size_t numSamples,
+                                        size_t blockSize,
+                                        size_t fftSize,
+                                        const FFTBackend& fft)
+    {
         size_t currentPtr = 0;
 
-        for (auto& buf : buffersImpulseSegments)
+        for (auto& buf : segments)
         {
             buf.clear();
 
             auto* impulseResponse = buf.getWritePointer (0);
 
-            if (&buf == &buffersImpulseSegments.front())
+            if (&buf == &segments.front())
                 impulseResponse[0] = 1.0f;
 
             FloatVectorOperations::copy (impulseResponse,
                                          samples + currentPtr,
                                          static_cast<int> (jmin (fftSize - blockSize, numSamples - currentPtr)));
 
-            FFTTempObject->performRealOnlyForwardTransform (impulseResponse);
-            prepareForConvolution (impulseResponse);
+            fft.performRealOnlyForwardTransform (impulseResponse);
+            prepareForConvolution (impulseResponse, fftSize);
 
             currentPtr += (fftSize - blockSize);
         }
+    }
+
+    size_t getNumOutputs() const noexcept   { return numOutputs; }
+
+    // Partitions new impulse responses into the engine's own segments, one per
+    // output, and resets it. They must have the length the engine was built for.
+    // Doesn't allocate, but transforms every partition.
+    void setImpulseResponse (const float* const* samples, size_t numSamples)
+    {
+        jassert (getNumSegments (numSamples, blockSize, fftSize) == numSegments);
+
+        for (size_t i = 0; i < numOutputs; ++i)
+        {
+            prepareImpulseSegments (outputs[i].buffersImpulseSegments, samples[i], numSamples, blockSize, fftSize, *fftObject);
+            outputs[i].impulseSegments = &outputs[i].buffersImpulseSegments;
+        }
 
         reset();
     }
 
+    // Switches an output of the engine to another set of prepared impulse segments.
+    // The segments must have been prepared for the same block size and impulse
+    // response length, and must outlive their use by this engine. Doesn't allocate.
+    void setImpulseSegments (const std::vector<AudioBuffer<float>>& segments, size_t output) noexcept
+    {
+        jassert (segments.size() == numSegments);
+        jassert ((size_t) segments.front().getNumSamples() == fftSize * 2);
+        jassert (output < numOutputs);
+
+        outputs[output].impulseSegments = &segments;
+    }
+
+    // Blends several sets of prepared impulse segments into the engine's own
+    // segments and switches to them. The convolution is linear, so this gives the
+    // same result as blending the impulse responses in the time domain, without
+    // any FFT. Doesn't allocate.
+    void setBlendedImpulseSegments (const std::vector<AudioBuffer<float>>* const* sources,
+                                    const float* weights,
+                                    size_t numSources,
+                                    size_t output) noexcept
+    {
+        jassert (numSources > 0);
+        jassert (output < numOutputs);
+
+        auto& out = outputs[output];
+
+        // a blend that is being faded out must stay intact, so blends alternate
+        // between two destinations
+        auto& buffersImpulseSegments = out.previousImpulseSegments == &out.buffersImpulseSegments ? out.buffersAlternateSegments
+                                                                                                   : out.buffersImpulseSegments;
+        jassert (buffersImpulseSegments.size() == numSegments);
+
+        const auto numSamplesToBlend = static_cast<int> (fftSize + 1);
+
+        for (size_t segment = 0; segment < numSegments; ++segment)
+        {
+            auto* blended = buffersImpulseSegments[segment].getWritePointer (0);
+
+            FloatVectorOperations::copyWithMultiply (blended, (*sources[0])[segment].getReadPointer (0), weights[0], numSamplesToBlend);
+
+            for (size_t i = 1; i < numSources; ++i)
+                FloatVectorOperations::addWithMultiply (blended, (*sources[i])[segment].getReadPointer (0), weights[i], numSamplesToBlend);
+        }
+
+        out.impulseSegments = &buffersImpulseSegments;
+    }
+
+    // Starts fading from the impulse segments in use to the ones set afterwards with
+    // setImpulseSegments() or setBlendedImpulseSegments(), over numSamples. Both are
+    // multiplied with the same input spectra and only their blend goes through the
+    // inverse transform, so a transition costs one extra multiply-accumulate per
+    // output instead of a second engine. The gains change once per block.
+    //
+    // With inTimeDomain, both products go through their own inverse transform
+    // instead, and the outputs are crossfaded sample by sample. That costs one more
+    // inverse transform per output and block. It interpolates between the two
+    // filters once a new block starts. Before that, the older partitions and the
+    // overlap of the new output were still summed with the old segments. Engines
+    // with latency always blend the spectra.
+    //
+    // Only for engines built on shared segments. Doesn't allocate.
+    void beginTransition (size_t numSamples, Convolution::TransitionCurve curve, bool inTimeDomain = false) noexcept
+    {
+        for (size_t i = 0; i < numOutputs; ++i)
+        {
+            auto& out = outputs[i];
+            jassert (out.bufferPreviousOutput.getNumSamples() > 0);
+
+            out.previousImpulseSegments = out.impulseSegments;
+
+            // the partial sum of the current block was made with the old segments
+            FloatVectorOperations::copy (out.bufferPreviousTempOutput.getWritePointer (0),
+                                         out.bufferTempOutput.getReadPointer (0),
+                                         static_cast<int> (fftSize + 1));
+
+            // so was the overlap, the new segments take it over as well
+            FloatVectorOperations::copy (out.bufferPreviousOverlap.getWritePointer (0),
+                                         out.bufferOverlap.getReadPointer (0),
+                                         static_cast<int> (fftSize));
+        }
+
+        transitionLength = jmax ((size_t) 1, numSamples);
+        transitionPosition = 0;
+        transitionCurve = curve;
+        isTimeDomainTransition = inTimeDomain;
+        previousGain = 1.0f;
+        currentGain = 0.0f;
+    }
+
+    bool isTransitioning() const noexcept   { return outputs[0].previousImpulseSegments != nullptr; }
+
     void reset()
     {
         bufferInput.clear();
-        bufferOverlap.clear();
-        bufferTempOutput.clear();
-        bufferOutput.clear();
+
+        for (size_t i = 0; i < numOutputs; ++i)
+        {
+            outputs[i].bufferOverlap.clear();
+            outputs[i].bufferTempOutput.clear();
+            outputs[i].bufferOutput.clear();
+            outputs[i].bufferPreviousOverlap.clear();
+            outputs[i].previousImpulseSegments = nullptr;
+        }
 
         for (auto& buf : buffersInputSegments)
             buf.clear();
 
+        previousGain = 0.0f;
+        currentGain = 1.0f;
         currentSegment = 0;
         inputDataPos = 0;
     }
 
-    void processSamples (const float* input, float* output, size_t numSamples)
+    // Writes one channel per output. The input is read before anything is written,
+    // so it may be the same as one of the outputs.
+    void processSamples (const float* input, float* const* outputChannels, size_t numSamples)
     {
         // Overlap-add, zero latency convolution algorithm with uniform partitioning
         size_t numSamplesProcessed = 0;
 
-        auto indexStep = numInputSegments / numSegments;
-
-        auto* inputData      = bufferInput.getWritePointer (0);
-        auto* outputTempData = bufferTempOutput.getWritePointer (0);
-        auto* outputData     = bufferOutput.getWritePointer (0);
-        auto* overlapData    = bufferOverlap.getWritePointer (0);
+        auto* inputData = bufferInput.getWritePointer (0);
 
         while (numSamplesProcessed < numSamples)
         {
@@ -241,39 +465,62 @@ struct ConvolutionEngine
             FloatVectorOperations::copy (inputSegmentData, inputData, static_cast<int> (fftSize));
 
             fftObject->performRealOnlyForwardTransform (inputSegmentData);
-            prepareForConvolution (inputSegmentData);
+            prepareForConvolution (inputSegmentData, fftSize);
+
+            const auto isCrossfading = isTransitioning() && isTimeDomainTransition;
 
-            // Complex multiplication
-            if (inputDataWasEmpty)
+            if (isCrossfading)
+                fillTransitionGains (numSamplesToProcess);
+            else if (inputDataWasEmpty)
+                advanceTransition (blockSize);
+
+            for (size_t o = 0; o < numOutputs; ++o)
             {
-                FloatVectorOperations::fill (outputTempData, 0, static_cast<int> (fftSize + 1));
+                auto& out = outputs[o];
+                auto* outputTempData = out.bufferTempOutput.getWritePointer (0);
+                auto* outputData     = out.bufferOutput.getWritePointer (0);
+                auto* overlapData    = out.bufferOverlap.getWritePointer (0);
+
+                // Complex multiplication, the older partitions only change once per block
+                if (inputDataWasEmpty)
+                    multiplyAccumulate (*out.impulseSegments, 1, numSegments, nullptr, outputTempData, false);
 
-                auto index = currentSegment;
+                multiplyAccumulate (*out.impulseSegments, 0, 1, outputTempData, outputData, true);
 
-                for (size_t i = 1; i < numSegments; ++i)
+                if (out.previousImpulseSegments != nullptr)
                 {
-                    index += indexStep;
+                    auto* previousTempData = out.bufferPreviousTempOutput.getWritePointer (0);
+                    auto* previousData     = out.bufferPreviousOutput.getWritePointer (0);
 
-                    if (index >= numInputSegments)
-                        index -= numInputSegments;
+                    if (inputDataWasEmpty)
+                        multiplyAccumulate (*out.previousImpulseSegments, 1, numSegments, nullptr, previousTempData, false);
 
-                    convolutionProcessingAndAccumulate (buffersInputSegments[index].getWritePointer (0),
-                                                        buffersImpulseSegments[i].getWritePointer (0),
-                                                        outputTempData);
+                    multiplyAccumulate (*out.previousImpulseSegments, 0, 1, previousTempData, previousData, true);
+
+                    if (! isCrossfading)
+                        blendWithPrevious (outputData, previousData);
                 }
-            }
 
-            FloatVectorOperations::copy (outputData, outputTempData, static_cast<int> (fftSize + 1));
+                fftObject->performRealOnlyInverseTransform (outputData);
 
-            convolutionProcessingAndAccumulate (inputSegmentData,
-                                                buffersImpulseSegments.front().getWritePointer (0),
-                                                outputData);
+                if (isCrossfading)
+                {
+                    auto* previousData        = out.bufferPreviousOutput.getWritePointer (0);
+                    auto* previousOverlapData = out.bufferPreviousOverlap.getWritePointer (0);
 
-            updateSymmetricFrequencyDomainData (outputData);
-            fftObject->performRealOnlyInverseTransform (outputData);
+                    fftObject->performRealOnlyInverseTransform (previousData);
 
-            // Add overlap
-            FloatVectorOperations::add (&output[numSamplesProcessed], &outputData[inputDataPos], &overlapData[inputDataPos], (int) numSamplesToProcess);
+                    crossfadeWithPrevious (&outputChannels[o][numSamplesProcessed],
+                                           &outputData[inputDataPos], &overlapData[inputDataPos],
+                                           &previousData[inputDataPos], &previousOverlapData[inputDataPos],
+                                           numSamplesToProcess);
+                }
+                else
+                {
+                    // Add overlap
+                    FloatVectorOperations::add (&outputChannels[o][numSamplesProcessed], &outputData[inputDataPos], &overlapData[inputDataPos], (int) numSamplesToProcess);
+                }
+            }
 
             // Input buffer full => Next block
             inputDataPos += numSamplesToProcess;
@@ -285,30 +532,32 @@ struct ConvolutionEngine
 
                 inputDataPos = 0;
 
-                // Extra step for segSize > blockSize
-                FloatVectorOperations::add (&(outputData[blockSize]), &(overlapData[blockSize]), static_cast<int> (fftSize - 2 * blockSize));
+                for (size_t o = 0; o < numOutputs; ++o)
+                {
+                    saveOverlap (outputs[o].bufferOutput.getWritePointer (0), outputs[o].bufferOverlap.getWritePointer (0));
 
-                // Save the overlap
-                FloatVectorOperations::copy (overlapData, &(outputData[blockSize]), static_cast<int> (fftSize - blockSize));
+                    // the outgoing filter keeps its own overlap until it is faded out
+                    if (isCrossfading)
+                        saveOverlap (outputs[o].bufferPreviousOutput.getWritePointer (0), outputs[o].bufferPreviousOverlap.getWritePointer (0));
+                }
 
                 currentSegment = (currentSegment > 0) ? (currentSegment - 1) : (numInputSegments - 1);
             }
 
+            // only ended here, the samples of this chunk still needed the previous segments
+            if (isCrossfading && transitionPosition == transitionLength)
+                endTransition();
+
             numSamplesProcessed += numSamplesToProcess;
         }
     }
 
-    void processSamplesWithAddedLatency (const float* input, float* output, size_t numSamples)
+    void processSamplesWithAddedLatency (const float* input, float* const* outputChannels, size_t numSamples)
     {
         // Overlap-add, zero latency convolution algorithm with uniform partitioning
         size_t numSamplesProcessed = 0;
 
-        auto indexStep = numInputSegments / numSegments;
-
-        auto* inputData      = bufferInput.getWritePointer (0);
-        auto* outputTempData = bufferTempOutput.getWritePointer (0);
-        auto* outputData     = bufferOutput.getWritePointer (0);
-        auto* overlapData    = bufferOverlap.getWritePointer (0);
+        auto* inputData = bufferInput.getWritePointer (0);
 
         while (numSamplesProcessed < numSamples)
         {
@@ -316,7 +565,10 @@ struct ConvolutionEngine
 
             FloatVectorOperations::copy (inputData + inputDataPos, input + numSamplesProcessed, static_cast<int> (numSamplesToProcess));
 
-            FloatVectorOperations::copy (output + numSamplesProcessed, outputData + inputDataPos, static_cast<int> (numSamplesToProcess));
+            for (size_t o = 0; o < numOutputs; ++o)
+                FloatVectorOperations::copy (outputChannels[o] + numSamplesProcessed,
+                                             outputs[o].bufferOutput.getReadPointer (0, static_cast<int> (inputDataPos)),
+                                             static_cast<int> (numSamplesToProcess));
 
             numSamplesProcessed += numSamplesToProcess;
             inputDataPos += numSamplesToProcess;
@@ -329,46 +581,43 @@ struct ConvolutionEngine
                 FloatVectorOperations::copy (inputSegmentData, inputData, static_cast<int> (fftSize));
 
                 fftObject->performRealOnlyForwardTransform (inputSegmentData);
-                prepareForConvolution (inputSegmentData);
+                prepareForConvolution (inputSegmentData, fftSize);
 
-                // Complex multiplication
-                FloatVectorOperations::fill (outputTempData, 0, static_cast<int> (fftSize + 1));
+                // the output only changes once per block here, so do the gains
+                advanceTransition (blockSize);
 
-                auto index = currentSegment;
-
-                for (size_t i = 1; i < numSegments; ++i)
+                for (size_t o = 0; o < numOutputs; ++o)
                 {
-                    index += indexStep;
+                    auto& out = outputs[o];
+                    auto* outputData  = out.bufferOutput.getWritePointer (0);
+                    auto* overlapData = out.bufferOverlap.getWritePointer (0);
 
-                    if (index >= numInputSegments)
-                        index -= numInputSegments;
+                    // Complex multiplication
+                    multiplyAccumulate (*out.impulseSegments, 0, numSegments, nullptr, outputData, true);
 
-                    convolutionProcessingAndAccumulate (buffersInputSegments[index].getWritePointer (0),
-                                                        buffersImpulseSegments[i].getWritePointer (0),
-                                                        outputTempData);
-                }
+                    if (out.previousImpulseSegments != nullptr)
+                    {
+                        auto* previousData = out.bufferPreviousOutput.getWritePointer (0);
 
-                FloatVectorOperations::copy (outputData, outputTempData, static_cast<int> (fftSize + 1));
+                        multiplyAccumulate (*out.previousImpulseSegments, 0, numSegments, nullptr, previousData, true);
+                        blendWithPrevious (outputData, previousData);
+                    }
 
-                convolutionProcessingAndAccumulate (inputSegmentData,
-                                                    buffersImpulseSegments.front().getWritePointer (0),
-                                                    outputData);
+                    fftObject->performRealOnlyInverseTransform (outputData);
 
-                updateSymmetricFrequencyDomainData (outputData);
-                fftObject->performRealOnlyInverseTransform (outputData);
+                    // Add overlap
+                    FloatVectorOperations::add (outputData, overlapData, static_cast<int> (blockSize));
 
-                // Add overlap
-                FloatVectorOperations::add (outputData, overlapData, static_cast<int> (blockSize));
+                    // Extra step for segSize > blockSize
+                    FloatVectorOperations::add (&(outputData[blockSize]), &(overlapData[blockSize]), static_cast<int> (fftSize - 2 * blockSize));
+
+                    // Save the overlap
+                    FloatVectorOperations::copy (overlapData, &(outputData[blockSize]), static_cast<int> (fftSize - blockSize));
+                }
 
                 // Input buffer is empty again now
                 FloatVectorOperations::fill (inputData, 0.0f, static_cast<int> (fftSize));
 
-                // Extra step for segSize > blockSize
-                FloatVectorOperations::add (&(outputData[blockSize]), &(overlapData[blockSize]), static_cast<int> (fftSize - 2 * blockSize));
-
-                // Save the overlap
-                FloatVectorOperations::copy (overlapData, &(outputData[blockSize]), static_cast<int> (fftSize - blockSize));
-
                 currentSegment = (currentSegment > 0) ? (currentSegment - 1) : (numInputSegments - 1);
 
                 inputDataPos = 0;
@@ -376,10 +625,17 @@ struct ConvolutionEngine
         }
     }
 
-    // After each FFT, this function is called to allow convolution to be performed with only 4 SIMD functions calls.
-    void prepareForConvolution (float *samples) noexcept
+    // After each FFT, this function is called to split the spectrum into real and
+    // imaginary parts, the layout the SpectrumKernels work on. Only reads the
+    // non-negative frequencies, the space after them holds the imaginary parts
+    // meanwhile.
+    static void prepareForConvolution (float *samples, size_t fftSize) noexcept
     {
         auto FFTSizeDiv2 = fftSize / 2;
+        auto* imaginary = samples + fftSize + 1;
+
+        for (size_t i = 1; i < FFTSizeDiv2; i++)
+            imaginary[i] = samples[(i << 1) + 1];
 
         for (size_t i = 0; i < FFTSizeDiv2; i++)
             samples[i] = samples[i << 1];
@@ -387,101 +643,666 @@ struct ConvolutionEngine
         samples[FFTSizeDiv2] = 0;
 
         for (size_t i = 1; i < FFTSizeDiv2; i++)
-            samples[i + FFTSizeDiv2] = -samples[((fftSize - i) << 1) + 1];
+            samples[i + FFTSizeDiv2] = imaginary[i];
     }
 
-    // Does the convolution operation itself only on half of the frequency domain samples.
-    void convolutionProcessingAndAccumulate (const float *input, const float *impulse, float *output)
+    struct Output
     {
-        auto FFTSizeDiv2 = fftSize / 2;
+        AudioBuffer<float> bufferOutput, bufferTempOutput, bufferOverlap;
+        AudioBuffer<float> bufferPreviousOutput, bufferPreviousTempOutput, bufferPreviousOverlap;
+        std::vector<AudioBuffer<float>> buffersImpulseSegments, buffersAlternateSegments;
+        const std::vector<AudioBuffer<float>>* impulseSegments = nullptr;
+        const std::vector<AudioBuffer<float>>* previousImpulseSegments = nullptr;
+    };
+
+    // Called at the start of every block, or sub-block. Ends the transition once
+    // the previous segments are faded out completely.
+    void advanceTransition (size_t numSamples) noexcept
+    {
+        if (! isTransitioning())
+            return;
 
-        FloatVectorOperations::addWithMultiply      (output, input, impulse, static_cast<int> (FFTSizeDiv2));
-        FloatVectorOperations::subtractWithMultiply (output, &(input[FFTSizeDiv2]), &(impulse[FFTSizeDiv2]), static_cast<int> (FFTSizeDiv2));
+        transitionPosition = jmin (transitionLength, transitionPosition + numSamples);
+        getTransitionGains (transitionCurve,
+                            static_cast<float> (transitionPosition) / static_cast<float> (transitionLength),
+                            previousGain,
+                            currentGain);
 
-        FloatVectorOperations::addWithMultiply      (&(output[FFTSizeDiv2]), input, &(impulse[FFTSizeDiv2]), static_cast<int> (FFTSizeDiv2));
-        FloatVectorOperations::addWithMultiply      (&(output[FFTSizeDiv2]), &(input[FFTSizeDiv2]), impulse, static_cast<int> (FFTSizeDiv2));
+        if (transitionPosition == transitionLength)
+            endTransition();
+    }
 
-        output[fftSize] += input[fftSize] * impulse[fftSize];
+    void endTransition() noexcept
+    {
+        for (size_t i = 0; i < numOutputs; ++i)
+            outputs[i].previousImpulseSegments = nullptr;
     }
 
-    // Undoes the re-organization of samples from the function prepareForConvolution.
-    // Then takes the conjugate of the frequency domain first half of samples to fill the
-    // second half, so that the inverse transform will return real samples in the time domain.
-    void updateSymmetricFrequencyDomainData (float* samples) noexcept
+    // Writes the gains of the next numSamples of a time domain transition, see
+    // beginTransition(), and advances it. Doesn't end it.
+    void fillTransitionGains (size_t numSamples) noexcept
     {
-        auto FFTSizeDiv2 = fftSize / 2;
+        auto* previousGains = bufferTransitionGains.getWritePointer (0);
+        auto* currentGains  = bufferTransitionGains.getWritePointer (1);
 
-        for (size_t i = 1; i < FFTSizeDiv2; i++)
+        for (size_t i = 0; i < numSamples; ++i)
         {
-            samples[(fftSize - i) << 1] = samples[i];
-            samples[((fftSize - i) << 1) + 1] = -samples[FFTSizeDiv2 + i];
+            transitionPosition = jmin (transitionLength, transitionPosition + 1);
+            getTransitionGains (transitionCurve,
+                                static_cast<float> (transitionPosition) / static_cast<float> (transitionLength),
+                                previousGains[i],
+                                currentGains[i]);
         }
+    }
 
-        samples[1] = 0.f;
+    // Crossfades the outputs of the previous and the current segments, both with
+    // their overlap, using the gains of fillTransitionGains()
+    void crossfadeWithPrevious (float* destination,
+                                const float* output, const float* overlap,
+                                const float* previousOutput, const float* previousOverlap,
+                                size_t numSamples) const noexcept
+    {
+        const auto* previousGains = bufferTransitionGains.getReadPointer (0);
+        const auto* currentGains  = bufferTransitionGains.getReadPointer (1);
 
-        for (size_t i = 1; i < FFTSizeDiv2; i++)
+        for (size_t i = 0; i < numSamples; ++i)
+            destination[i] = currentGains[i]  * (output[i] + overlap[i])
+                           + previousGains[i] * (previousOutput[i] + previousOverlap[i]);
+    }
+
+    // Called once a block is complete
+    void saveOverlap (float* outputData, float* overlapData) const noexcept
+    {
+        // Extra step for segSize > blockSize
+        FloatVectorOperations::add (&(outputData[blockSize]), &(overlapData[blockSize]), static_cast<int> (fftSize - 2 * blockSize));
+
+        // Save the overlap
+        FloatVectorOperations::copy (overlapData, &(outputData[blockSize]), static_cast<int> (fftSize - blockSize));
+    }
+
+    // Crossfades two interleaved output spectra, the result goes into the first one
+    void blendWithPrevious (float* spectrum, const float* previousSpectrum) const noexcept
+    {
+        const auto numSamplesToBlend = static_cast<int> (fftSize + 2);
+
+        FloatVectorOperations::multiply (spectrum, currentGain, numSamplesToBlend);
+        FloatVectorOperations::addWithMultiply (spectrum, previousSpectrum, previousGain, numSamplesToBlend);
+    }
+
+    // Sums the products of the impulse partitions first..last-1 with the matching
+    // input partitions, see SpectrumProducts. The interleaved result can go
+    // straight into the inverse transform, which only reads the non-negative
+    // frequencies.
+    void multiplyAccumulate (const std::vector<AudioBuffer<float>>& impulseSegments, size_t first, size_t last, const float* partialSum, float* result, bool interleave) noexcept
+    {
+        const auto indexStep = numInputSegments / numSegments;
+        auto index = currentSegment;
+        size_t numPartitions = 0;
+
+        for (size_t i = 0; i < last; ++i)
         {
-            samples[i << 1] = samples[(fftSize - i) << 1];
-            samples[(i << 1) + 1] = -samples[((fftSize - i) << 1) + 1];
+            if (i >= first)
+            {
+                inputPointers[numPartitions]   = buffersInputSegments[index].getReadPointer (0);
+                impulsePointers[numPartitions] = impulseSegments[i].getReadPointer (0);
+                ++numPartitions;
+            }
+
+            index += indexStep;
+
+            if (index >= numInputSegments)
+                index -= numInputSegments;
         }
+
+        const SpectrumProducts products { inputPointers.data(), impulsePointers.data(), numPartitions,
+                                          partialSum, result, fftSize / 2, interleave };
+        spectrumKernel (products);
+
+        // the Nyquist bin is real
+        auto nyquist = partialSum != nullptr ? partialSum[fftSize] : 0.0f;
+
+        for (size_t i = 0; i < numPartitions; ++i)
+            nyquist += inputPointers[i][fftSize] * impulsePointers[i][fftSize];
+
+        result[fftSize] = nyquist;
+
+        if (interleave)
+            result[fftSize + 1] = 0.0f;
     }
 
     //==============================================================================
     const size_t blockSize;
     const size_t fftSize;
-    const std::unique_ptr<FFT> fftObject;
+    // borrowed from the cache shared by all engines with FFTW, the engine's own otherwise
+    const std::shared_ptr<const FFTBackend> fftObject;
     const size_t numSegments;
     const size_t numInputSegments;
+    const size_t numOutputs;
     size_t currentSegment = 0, inputDataPos = 0;
 
-    AudioBuffer<float> bufferInput, bufferOutput, bufferTempOutput, bufferOverlap;
-    std::vector<AudioBuffer<float>> buffersInputSegments, buffersImpulseSegments;
+    // fade out of the previous impulse segments, see beginTransition()
+    size_t transitionLength = 1, transitionPosition = 0;
+    Convolution::TransitionCurve transitionCurve = Convolution::TransitionCurve::linear;
+    float previousGain = 0.0f, currentGain = 1.0f;
+    bool isTimeDomainTransition = false;
+    AudioBuffer<float> bufferTransitionGains;
+
+    // The input and its frequency domain delay line are shared by all outputs
+    AudioBuffer<float> bufferInput;
+    std::vector<AudioBuffer<float>> buffersInputSegments;
+
+    // partitions of the current multiplyAccumulate call, preallocated
+    std::vector<const float*> inputPointers, impulsePointers;
+    const SpectrumKernel spectrumKernel;
+
+    Output outputs[maxNumOutputs];
+};
+
+//==============================================================================
+// Time domain kernels of the DirectFormEngine. They compute
+// output[n] = sum over k of taps[k] * history[n + k] with the taps stored in
+// reverse order, vectorised over the output samples. The AVX2 one is compiled
+// for that instruction set only and picked at runtime, the others are baseline.
+using DirectFormKernel = void (*) (const float*, size_t, const float*, float*, size_t);
+
+static void processDirectFormScalar (const float* taps, size_t numTaps, const float* history, float* output, size_t begin, size_t numSamples) noexcept
+{
+    for (auto n = begin; n < numSamples; ++n)
+    {
+        auto sum = 0.0f;
+
+        for (size_t k = 0; k < numTaps; ++k)
+            sum += taps[k] * history[n + k];
+
+        output[n] = sum;
+    }
+}
+
+#if CUSTOM_JUCE_X86_KERNELS
+CUSTOM_JUCE_TARGET_AVX2
+static void processDirectFormAVX2 (const float* taps, size_t numTaps, const float* history, float* output, size_t numSamples) noexcept
+{
+    size_t n = 0;
+
+    for (; n + 16 <= numSamples; n += 16)
+    {
+        auto sum0 = _mm256_setzero_ps();
+        auto sum1 = _mm256_setzero_ps();
+
+        for (size_t k = 0; k < numTaps; ++k)
+        {
+            const auto tap = _mm256_set1_ps (taps[k]);
+            sum0 = _mm256_fmadd_ps (tap, _mm256_loadu_ps (history + n + k), sum0);
+            sum1 = _mm256_fmadd_ps (tap, _mm256_loadu_ps (history + n + k + 8), sum1);
+        }
+
+        _mm256_storeu_ps (output + n, sum0);
+        _mm256_storeu_ps (output + n + 8, sum1);
+    }
+
+    processDirectFormScalar (taps, numTaps, history, output, n, numSamples);
+}
+
+static void processDirectFormSSE (const float* taps, size_t numTaps, const float* history, float* output, size_t numSamples) noexcept
+{
+    size_t n = 0;
+
+    for (; n + 8 <= numSamples; n += 8)
+    {
+        auto sum0 = _mm_setzero_ps();
+        auto sum1 = _mm_setzero_ps();
+
+        for (size_t k = 0; k < numTaps; ++k)
+        {
+            const auto tap = _mm_set1_ps (taps[k]);
+            sum0 = _mm_add_ps (sum0, _mm_mul_ps (tap, _mm_loadu_ps (history + n + k)));
+            sum1 = _mm_add_ps (sum1, _mm_mul_ps (tap, _mm_loadu_ps (history + n + k + 4)));
+        }
+
+        _mm_storeu_ps (output + n, sum0);
+        _mm_storeu_ps (output + n + 4, sum1);
+    }
+
+    processDirectFormScalar (taps, numTaps, history, output, n, numSamples);
+}
+#elif CUSTOM_JUCE_NEON_KERNELS
+static void processDirectFormNEON (const float* taps, size_t numTaps, const float* history, float* output, size_t numSamples) noexcept
+{
+    size_t n = 0;
+
+    for (; n + 8 <= numSamples; n += 8)
+    {
+        auto sum0 = vdupq_n_f32 (0.0f);
+        auto sum1 = vdupq_n_f32 (0.0f);
+
+        for (size_t k = 0; k < numTaps; ++k)
+        {
+            const auto tap = vdupq_n_f32 (taps[k]);
+            sum0 = vmlaq_f32 (sum0, tap, vld1q_f32 (history + n + k));
+            sum1 = vmlaq_f32 (sum1, tap, vld1q_f32 (history + n + k + 4));
+        }
+
+        vst1q_f32 (output + n, sum0);
+        vst1q_f32 (output + n + 4, sum1);
+    }
+
+    processDirectFormScalar (taps, numTaps, history, output, n, numSamples);
+}
+#else
+static void processDirectFormScalar (const float* taps, size_t numTaps, const float* history, float* output, size_t numSamples) noexcept
+{
+    processDirectFormScalar (taps, numTaps, history, output, 0, numSamples);
+}
+#endif
+
+//==============================================================================
+// Zero latency time domain convolution of a single channel. For short impulse
+// responses (e.g. truncated HRIRs) at small block sizes this is cheaper than the
+// partitioned FFT engine, which has to transform at least twice the block size.
+struct DirectFormEngine
+{
+    DirectFormEngine (const float* samples,
+                      size_t numSamples,
+                      size_t maxBlockSizeIn)
+        : numTaps (jmax ((size_t) 1, numSamples)),
+          maxBlockSize (jmax ((size_t) 1, maxBlockSizeIn)),
+          taps (numTaps, 0.0f),
+          history (numTaps - 1 + maxBlockSize, 0.0f),
+          kernel (getKernel())
+    {
+        setImpulseResponse (samples, numSamples);
+    }
+
+    // Takes another impulse response of the same length and resets the engine
+    void setImpulseResponse (const float* samples, size_t numSamples) noexcept
+    {
+        jassert (jmax ((size_t) 1, numSamples) == numTaps);
+
+        for (size_t k = 0; k < numSamples; ++k)
+            taps[k] = samples[numSamples - 1 - k];
+
+        reset();
+    }
+
+    // Longest impulse response the time domain path is considered for
+    static constexpr size_t maxNumTaps = 256;
+
+    // Compares against the cost model of ConvolutionEngine::getFFTSize, in the same
+    // units: one multiply-add per tap and output sample, spread over the lanes.
+    static bool isCheaper (size_t numSamples, size_t maxBlockSize) noexcept
+    {
+        if (numSamples == 0 || numSamples > maxNumTaps)
+            return false;
+
+        const auto blockSize = ConvolutionEngine::getBlockSize (maxBlockSize);
+        const auto fftCost = ConvolutionEngine::getCost (blockSize, numSamples, ConvolutionEngine::getFFTSize (blockSize, numSamples));
+        const auto directCost = static_cast<double> (numSamples * blockSize) / static_cast<double> (getNumLanes());
+
+        // the frequency domain path also reorders and copies its spectra every block
+        return directCost <= 2.0 * fftCost;
+    }
+
+    void reset()
+    {
+        std::fill (history.begin(), history.end(), 0.0f);
+    }
+
+    void processSamples (const float* input, float* output, size_t numSamples) noexcept
+    {
+        const auto numPastSamples = numTaps - 1;
+
+        for (size_t numSamplesProcessed = 0; numSamplesProcessed < numSamples;)
+        {
+            const auto numSamplesToProcess = jmin (numSamples - numSamplesProcessed, maxBlockSize);
+
+            // the input is stored before anything is written, input and output may be the same
+            FloatVectorOperations::copy (history.data() + numPastSamples, input + numSamplesProcessed, static_cast<int> (numSamplesToProcess));
+
+            kernel (taps.data(), numTaps, history.data(), output + numSamplesProcessed, numSamplesToProcess);
+
+            std::copy (history.begin() + static_cast<std::ptrdiff_t> (numSamplesToProcess),
+                       history.begin() + static_cast<std::ptrdiff_t> (numSamplesToProcess + numPastSamples),
+                       history.begin());
+
+            numSamplesProcessed += numSamplesToProcess;
+        }
+    }
+
+private:
+    static bool hasAVX2() noexcept
+    {
+       #if CUSTOM_JUCE_X86_KERNELS
+        return SystemStats::hasAVX2() && SystemStats::hasFMA3();
+       #else
+        return false;
+       #endif
+    }
+
+    static size_t getNumLanes() noexcept
+    {
+       #if CUSTOM_JUCE_X86_KERNELS || CUSTOM_JUCE_NEON_KERNELS
+        return hasAVX2() ? 8 : 4;
+       #else
+        return 1;
+       #endif
+    }
+
+    static DirectFormKernel getKernel() noexcept
+    {
+       #if CUSTOM_JUCE_X86_KERNELS
+        return hasAVX2() ? processDirectFormAVX2 : processDirectFormSSE;
+       #elif CUSTOM_JUCE_NEON_KERNELS
+        return processDirectFormNEON;
+       #else
+        return processDirectFormScalar;
+       #endif
+    }
+
+    const size_t numTaps;
+    const size_t maxBlockSize;
+
+    // reversed, so that every output sample reads the history forwards
+    std::vector<float> taps;
+    // the last numTaps - 1 input samples, followed by the current block
+    std::vector<float> history;
+
+    const DirectFormKernel kernel;
+};
+
+//==============================================================================
+// Holds the partitioned spectra of a whole set of stereo impulse responses, laid
+// out exactly like ConvolutionEngine::buffersImpulseSegments, so that an engine
+// can switch between them by swapping a pointer.
+// Channels 2 * i and 2 * i + 1 of the source buffer are the left and right
+// impulse responses of entry i. The generation is the one the caller passed to
+// Convolution::loadImpulseResponseSet().
+class ImpulseResponseSet
+{
+public:
+    ImpulseResponseSet (const AudioBuffer<float>& buf, size_t maxBlockSize, double sampleRateIn, int generationIn)
+        : blockSize (ConvolutionEngine::getBlockSize (maxBlockSize)),
+          fftSize (ConvolutionEngine::getFFTSize (blockSize, static_cast<size_t> (buf.getNumSamples()))),
+          irSize (buf.getNumSamples()),
+          sampleRate (sampleRateIn),
+          generation (generationIn)
+    {
+        const auto numSamples = static_cast<size_t> (irSize);
+        const auto numSegments = ConvolutionEngine::getNumSegments (numSamples, blockSize, fftSize);
+        const auto fft = FFTBackend::getShared (roundToInt (std::log2 (fftSize)));
+
+        segments.resize (static_cast<size_t> (2 * (buf.getNumChannels() / 2)));
+
+        for (size_t channel = 0; channel < segments.size(); ++channel)
+        {
+            ConvolutionEngine::updateSegmentsIfNecessary (numSegments, segments[channel], fftSize);
+            ConvolutionEngine::prepareImpulseSegments (segments[channel],
+                                                       buf.getReadPointer ((int) channel),
+                                                       numSamples,
+                                                       blockSize,
+                                                       fftSize,
+                                                       *fft);
+        }
+    }
+
+    int getNumImpulseResponses() const noexcept     { return static_cast<int> (segments.size() / 2); }
+    int getIRSize() const noexcept                  { return irSize; }
+    int getGeneration() const noexcept              { return generation; }
+
+    const std::vector<AudioBuffer<float>>& getSegments (int index, int channel) const noexcept
+    {
+        return segments[static_cast<size_t> (2 * index + jlimit (0, 1, channel))];
+    }
+
+    // Returns true if this set was prepared for engines built with the given spec.
+    bool matches (size_t maxBlockSize, double sampleRateToCheck) const noexcept
+    {
+        return ConvolutionEngine::getBlockSize (maxBlockSize) == blockSize
+            && approximatelyEqual (sampleRate, sampleRateToCheck);
+    }
+
+private:
+    const size_t blockSize, fftSize;
+    const int irSize;
+    const double sampleRate;
+    const int generation;
+    std::vector<std::vector<AudioBuffer<float>>> segments;
+};
+
+//==============================================================================
+// Up to three entries of an ImpulseResponseSet, and the weights they are blended
+// with. The indices only mean something for the set of the same generation.
+struct ImpulseResponseSelection
+{
+    static constexpr int maxEntries = 3;
+
+    static ImpulseResponseSelection single (int index, int generation) noexcept
+    {
+        ImpulseResponseSelection result;
+        result.indices[0] = index;
+        result.weights[0] = 1.0f;
+        result.numEntries = 1;
+        result.generation = generation;
+        return result;
+    }
+
+    bool operator== (const ImpulseResponseSelection& other) const noexcept
+    {
+        if (numEntries != other.numEntries || generation != other.generation)
+            return false;
+
+        for (int i = 0; i < numEntries; ++i)
+            if (indices[i] != other.indices[i] || ! exactlyEqual (weights[i], other.weights[i]))
+                return false;
+
+        return true;
+    }
+
+    bool operator!= (const ImpulseResponseSelection& other) const noexcept { return ! operator== (other); }
+
+    int indices[maxEntries] {};
+    float weights[maxEntries] {};
+    int numEntries = 0;
+    int generation = 0;
 };
 
 //==============================================================================
 class MultichannelEngine
 {
 public:
-    MultichannelEngine (const AudioBuffer<float>& buf,
-                        int maxBlockSize,
-                        int maxBufferSize,
-                        Convolution::NonUniform headSizeIn,
-                        bool isZeroDelayIn)
-        : tailBuffer (1, maxBlockSize),
-          latency (isZeroDelayIn ? 0 : maxBufferSize),
+    // Everything an engine for a single impulse response is built from, apart from
+    // the samples. Engines with the same layout can take each other's impulse
+    // responses, see loadImpulseResponse().
+    struct Layout
+    {
+        int numSamples, maxBlockSize, maxBufferSize;
+        Convolution::NonUniform headSize;
+        bool isZeroDelay, isMonoInput;
+
+        bool operator== (const Layout& other) const noexcept
+        {
+            return numSamples == other.numSamples
+                && maxBlockSize == other.maxBlockSize
+                && maxBufferSize == other.maxBufferSize
+                && headSize.headSizeInSamples == other.headSize.headSizeInSamples
+                && isZeroDelay == other.isZeroDelay
+                && isMonoInput == other.isMonoInput;
+        }
+    };
+
+    MultichannelEngine (const AudioBuffer<float>& buf, const Layout& layoutIn)
+        : tailBuffer (numChannels, layoutIn.maxBlockSize),
+          discardBuffer (1, layoutIn.maxBlockSize),
+          latency (layoutIn.isZeroDelay ? 0 : layoutIn.maxBufferSize),
           irSize (buf.getNumSamples()),
-          blockSize (maxBlockSize),
-          isZeroDelay (isZeroDelayIn)
+          blockSize (layoutIn.maxBlockSize),
+          isZeroDelay (layoutIn.isZeroDelay),
+          isMonoInput (layoutIn.isMonoInput),
+          layout (layoutIn),
+          headLength (layoutIn.headSize.headSizeInSamples == 0 ? irSize : jmin (irSize, layoutIn.headSize.headSizeInSamples))
     {
-        constexpr auto numChannels = 2;
+        jassert (layout.numSamples == irSize);
+
+        const auto maxBufferSize = layout.maxBufferSize;
 
-        const auto makeEngine = [&] (int channel, int offset, int length, uint32 thisBlockSize)
+        const auto makeEngine = [&] (int engine, int offset, int length, uint32 thisBlockSize)
         {
-            return std::make_unique<ConvolutionEngine> (buf.getReadPointer (jmin (buf.getNumChannels() - 1, channel), offset),
+            const auto samples = getChannelPointers (buf, engine, offset);
+
+            return std::make_unique<ConvolutionEngine> (samples.data(),
+                                                        static_cast<size_t> (getNumOutputsPerEngine()),
                                                         length,
                                                         static_cast<size_t> (thisBlockSize));
         };
 
-        if (headSizeIn.headSizeInSamples == 0)
+        const auto isUniformIn = headLength == irSize;
+
+        if (isZeroDelay && isUniformIn && DirectFormEngine::isCheaper ((size_t) irSize, (size_t) maxBufferSize))
         {
             for (int i = 0; i < numChannels; ++i)
-                head.emplace_back (makeEngine (i, 0, buf.getNumSamples(), static_cast<uint32> (maxBufferSize)));
+                direct.emplace_back (std::make_unique<DirectFormEngine> (buf.getReadPointer (jmin (buf.getNumChannels() - 1, i)),
+                                                                         (size_t) irSize,
+                                                                         (size_t) maxBufferSize));
         }
         else
         {
-            const auto size = jmin (buf.getNumSamples(), headSizeIn.headSizeInSamples);
+            for (int i = 0; i < getNumEngines(); ++i)
+                head.emplace_back (makeEngine (i, 0, headLength, static_cast<uint32> (maxBufferSize)));
 
-            for (int i = 0; i < numChannels; ++i)
-                head.emplace_back (makeEngine (i, 0, size, static_cast<uint32> (maxBufferSize)));
+            const auto tailBufferSize = static_cast<uint32> (layout.headSize.headSizeInSamples + (isZeroDelay ? 0 : maxBufferSize));
 
-            const auto tailBufferSize = static_cast<uint32> (headSizeIn.headSizeInSamples + (isZeroDelay ? 0 : maxBufferSize));
+            if (! isUniformIn)
+                for (int i = 0; i < getNumEngines(); ++i)
+                    tail.emplace_back (makeEngine (i, headLength, irSize - headLength, tailBufferSize));
+        }
+    }
+
+    // Builds an engine bound to a precomputed ImpulseResponseSet. The set is always
+    // processed with uniform partitioning, and selecting another entry of the set
+    // doesn't require a new engine.
+    MultichannelEngine (std::shared_ptr<const ImpulseResponseSet> setIn,
+                        int maxBlockSize,
+                        int maxBufferSize,
+                        bool isZeroDelayIn,
+                        bool isMonoInputIn)
+        : tailBuffer (numChannels, maxBlockSize),
+          discardBuffer (1, maxBlockSize),
+          latency (isZeroDelayIn ? 0 : maxBufferSize),
+          irSize (setIn->getIRSize()),
+          blockSize (maxBlockSize),
+          isZeroDelay (isZeroDelayIn),
+          isMonoInput (isMonoInputIn),
+          layout { irSize, maxBlockSize, maxBufferSize, {}, isZeroDelayIn, isMonoInputIn },
+          headLength (irSize),
+          set (std::move (setIn))
+    {
+        for (int i = 0; i < getNumEngines(); ++i)
+        {
+            const std::vector<AudioBuffer<float>>* segments[numChannels] {};
 
-            if (size != buf.getNumSamples())
-                for (int i = 0; i < numChannels; ++i)
-                    tail.emplace_back (makeEngine (i, size, buf.getNumSamples() - size, tailBufferSize));
+            for (int j = 0; j < getNumOutputsPerEngine(); ++j)
+                segments[j] = &set->getSegments (0, i + j);
+
+            head.emplace_back (std::make_unique<ConvolutionEngine> (segments,
+                                                                    static_cast<size_t> (getNumOutputsPerEngine()),
+                                                                    static_cast<size_t> (irSize),
+                                                                    static_cast<size_t> (maxBufferSize)));
         }
+
+        selection = ImpulseResponseSelection::single (0, set->getGeneration());
+    }
+
+    // Points the engine at another entry of its ImpulseResponseSet, or at a blend
+    // of up to three entries. A single entry only swaps a pointer, a blend mixes
+    // the precomputed spectra. Doesn't allocate. Returns false if this engine
+    // isn't bound to a set, if the selection was made for another generation of
+    // the set, or if an index is out of range.
+    bool selectImpulseResponses (const ImpulseResponseSelection& newSelection) noexcept
+    {
+        if (! canSelect (newSelection))
+            return false;
+
+        for (int channel = 0; channel < numChannels; ++channel)
+        {
+            auto& engine = *head[(size_t) (channel / getNumOutputsPerEngine())];
+            const auto output = (size_t) (channel % getNumOutputsPerEngine());
+
+            if (newSelection.numEntries == 1)
+            {
+                engine.setImpulseSegments (set->getSegments (newSelection.indices[0], channel), output);
+                continue;
+            }
+
+            const std::vector<AudioBuffer<float>>* sources[ImpulseResponseSelection::maxEntries];
+
+            for (int i = 0; i < newSelection.numEntries; ++i)
+                sources[i] = &set->getSegments (newSelection.indices[i], channel);
+
+            engine.setBlendedImpulseSegments (sources,
+                                              newSelection.weights,
+                                              static_cast<size_t> (newSelection.numEntries),
+                                              output);
+        }
+
+        selection = newSelection;
+        return true;
+    }
+
+    bool selectImpulseResponse (int index) noexcept
+    {
+        return selectImpulseResponses (ImpulseResponseSelection::single (index, set != nullptr ? set->getGeneration() : 0));
+    }
+
+    // Like selectImpulseResponses(), but fades from the entries in use to the new
+    // ones over numSamples, inside the same engine. See
+    // ConvolutionEngine::beginTransition(). Returns false if the selection can't be
+    // used, or if the previous transition isn't done yet. With inTimeDomain, the
+    // outputs are crossfaded per sample instead of the spectra per block.
+    bool crossfadeToImpulseResponses (const ImpulseResponseSelection& newSelection,
+                                      int numSamples,
+                                      Convolution::TransitionCurve curve,
+                                      bool inTimeDomain = false) noexcept
+    {
+        if (! canSelect (newSelection) || isTransitioning())
+            return false;
+
+        for (const auto& e : head)
+            e->beginTransition (static_cast<size_t> (numSamples), curve, inTimeDomain);
+
+        return selectImpulseResponses (newSelection);
+    }
+
+    bool isTransitioning() const noexcept
+    {
+        return std::any_of (head.begin(), head.end(), [] (const auto& e) { return e->isTransitioning(); });
+    }
+
+    // Returns true if loadImpulseResponse() can be used with an impulse response
+    // for this layout.
+    bool hasLayout (const Layout& other) const noexcept
+    {
+        return set == nullptr && layout == other;
+    }
+
+    // Writes another impulse response into the engine, reusing all of its buffers
+    // and transforms, and resets it. Used to recycle engines instead of building
+    // new ones. Doesn't allocate.
+    void loadImpulseResponse (const AudioBuffer<float>& buf)
+    {
+        jassert (set == nullptr && buf.getNumSamples() == irSize);
+
+        for (size_t i = 0; i < direct.size(); ++i)
+            direct[i]->setImpulseResponse (buf.getReadPointer (jmin (buf.getNumChannels() - 1, (int) i)), (size_t) irSize);
+
+        for (size_t i = 0; i < head.size(); ++i)
+            head[i]->setImpulseResponse (getChannelPointers (buf, (int) i, 0).data(), (size_t) headLength);
+
+        for (size_t i = 0; i < tail.size(); ++i)
+            tail[i]->setImpulseResponse (getChannelPointers (buf, (int) i, headLength).data(), (size_t) (irSize - headLength));
     }
 
+    const ImpulseResponseSet* getImpulseResponseSet() const noexcept   { return set.get(); }
+    const ImpulseResponseSelection& getSelection() const noexcept       { return selection; }
+
     void reset()
     {
         for (const auto& e : head)
@@ -489,41 +1310,64 @@ public:
 
         for (const auto& e : tail)
             e->reset();
+
+        for (const auto& e : direct)
+            e->reset();
     }
 
     void processSamples (const AudioBlock<const float>& input, AudioBlock<float>& output)
     {
-        const auto numChannels = jmin (head.size(), input.getNumChannels(), output.getNumChannels());
-        const auto numSamples  = jmin (input.getNumSamples(), output.getNumSamples());
+        if (! direct.empty())
+        {
+            processSamplesDirect (input, output);
+            return;
+        }
+
+        const auto numOutputChannels = output.getNumChannels();
+        const auto numSamples        = jmin (input.getNumSamples(), output.getNumSamples());
 
-        const AudioBlock<float> fullTailBlock (tailBuffer);
-        const auto tailBlock = fullTailBlock.getSubBlock (0, (size_t) numSamples);
+        // with a mono input, a single engine writes both channels
+        const auto numEngines = isMonoInput ? head.size()
+                                            : jmin (head.size(), input.getNumChannels(), numOutputChannels);
+        const auto numOutputs = (size_t) getNumOutputsPerEngine();
 
         const auto isUniform = tail.empty();
 
-        for (size_t channel = 0; channel < numChannels; ++channel)
+        for (size_t engine = 0; engine < numEngines; ++engine)
         {
+            float* outputChannels[numChannels] {};
+            float* tailChannels[numChannels] {};
+
+            for (size_t i = 0; i < numOutputs; ++i)
+            {
+                const auto channel = engine * numOutputs + i;
+
+                outputChannels[i] = channel < numOutputChannels ? output.getChannelPointer (channel)
+                                                                : discardBuffer.getWritePointer (0);
+                tailChannels[i] = tailBuffer.getWritePointer ((int) i);
+            }
+
             if (! isUniform)
-                tail[channel]->processSamplesWithAddedLatency (input.getChannelPointer (channel),
-                                                               tailBlock.getChannelPointer (0),
-                                                               numSamples);
+                tail[engine]->processSamplesWithAddedLatency (input.getChannelPointer (engine),
+                                                              tailChannels,
+                                                              numSamples);
 
             if (isZeroDelay)
-                head[channel]->processSamples (input.getChannelPointer (channel),
-                                               output.getChannelPointer (channel),
-                                               numSamples);
+                head[engine]->processSamples (input.getChannelPointer (engine),
+                                              outputChannels,
+                                              numSamples);
             else
-                head[channel]->processSamplesWithAddedLatency (input.getChannelPointer (channel),
-                                                               output.getChannelPointer (channel),
-                                                               numSamples);
+                head[engine]->processSamplesWithAddedLatency (input.getChannelPointer (engine),
+                                                              outputChannels,
+                                                              numSamples);
 
             if (! isUniform)
-                output.getSingleChannelBlock (channel) += tailBlock;
+                for (size_t i = 0; i < numOutputs; ++i)
+                    if (engine * numOutputs + i < numOutputChannels)
+                        FloatVectorOperations::add (outputChannels[i], tailChannels[i], (int) numSamples);
         }
 
-        const auto numOutputChannels = output.getNumChannels();
-
-        for (auto i = numChannels; i < numOutputChannels; ++i)
+        for (auto i = numEngines * numOutputs; i < numOutputChannels; ++i)
             output.getSingleChannelBlock (i).copyFrom (output.getSingleChannelBlock (0));
     }
 
@@ -532,13 +1376,73 @@ public:
     int getBlockSize() const noexcept  { return blockSize; }
 
 private:
+    static constexpr int numChannels = 2;
+
+    // Indices meant for another set are never applied, even if they are in range.
+    bool canSelect (const ImpulseResponseSelection& newSelection) const noexcept
+    {
+        if (set == nullptr || newSelection.numEntries <= 0 || newSelection.generation != set->getGeneration())
+            return false;
+
+        for (int i = 0; i < newSelection.numEntries; ++i)
+            if (! isPositiveAndBelow (newSelection.indices[i], set->getNumImpulseResponses()))
+                return false;
+
+        return true;
+    }
+
+    // with a mono input, both channels share one engine and its input spectra
+    int getNumOutputsPerEngine() const noexcept   { return isMonoInput ? numChannels : 1; }
+    int getNumEngines() const noexcept            { return numChannels / getNumOutputsPerEngine(); }
+
+    // the impulse responses of the outputs of one ConvolutionEngine
+    std::array<const float*, numChannels> getChannelPointers (const AudioBuffer<float>& buf, int engine, int offset) const noexcept
+    {
+        std::array<const float*, numChannels> result {};
+
+        for (int i = 0; i < getNumOutputsPerEngine(); ++i)
+            result[(size_t) i] = buf.getReadPointer (jmin (buf.getNumChannels() - 1, engine + i), offset);
+
+        return result;
+    }
+
+    void processSamplesDirect (const AudioBlock<const float>& input, AudioBlock<float>& output)
+    {
+        const auto numInputChannels = isMonoInput ? direct.size() : input.getNumChannels();
+        const auto numChannelsToProcess = jmin (direct.size(), numInputChannels, output.getNumChannels());
+        const auto numSamples = jmin (input.getNumSamples(), output.getNumSamples());
+
+        // backwards, so that with a mono input processed in place, the first channel
+        // is only overwritten once all channels have read it
+        for (auto channel = numChannelsToProcess; channel-- > 0;)
+            direct[channel]->processSamples (input.getChannelPointer (isMonoInput ? 0 : channel),
+                                             output.getChannelPointer (channel),
+                                             numSamples);
+
+        const auto numOutputChannels = output.getNumChannels();
+
+        for (auto i = numChannelsToProcess; i < numOutputChannels; ++i)
+            output.getSingleChannelBlock (i).copyFrom (output.getSingleChannelBlock (0));
+    }
+
     std::vector<std::unique_ptr<ConvolutionEngine>> head, tail;
+    // used instead of head for short impulse responses at zero latency
+    std::vector<std::unique_ptr<DirectFormEngine>> direct;
     AudioBuffer<float> tailBuffer;
+    // takes the second channel of a mono input engine when processing a mono block
+    AudioBuffer<float> discardBuffer;
 
     const int latency;
     const int irSize;
     const int blockSize;
     const bool isZeroDelay;
+    const bool isMonoInput;
+    const Layout layout;
+    // length of the part of the impulse response processed by the head engines
+    const int headLength;
+
+    std::shared_ptr<const ImpulseResponseSet> set;
+    ImpulseResponseSelection selection;
 };
 
 static AudioBuffer<float> fixNumChannels (const AudioBuffer<float>& buf, Convolution::Stereo stereo)
@@ -670,10 +1574,11 @@ template <typename Element>
 class TryLockedPtr
 {
 public:
-    void set (std::unique_ptr<Element> p)
+    // Returns the element that was replaced, if it wasn't picked up
+    std::unique_ptr<Element> set (std::unique_ptr<Element> p)
     {
         const SpinLock::ScopedLockType lock (mutex);
-        ptr = std::move (p);
+        return std::exchange (ptr, std::move (p));
     }
 
     std::unique_ptr<MultichannelEngine> get()
@@ -722,6 +1627,88 @@ static BufferWithSampleRate loadStreamToBuffer (std::unique_ptr<InputStream> str
     return result;
 }
 
+//==============================================================================
+// Keeps engines for single impulse responses around instead of destroying them.
+// The audio thread hands back the engines it doesn't need anymore, without freeing
+// anything, and the factory writes the next impulse response into one of them.
+// A few free engines of the current layout are kept in reserve, so that a stream
+// of impulse responses of the same length (e.g. HRIRs) doesn't allocate anymore
+// once the first ones are built.
+class ConvolutionEnginePool
+{
+public:
+    ConvolutionEnginePool()
+        : returned (maxNumEngines)
+    {
+        engines.reserve ((size_t) maxNumEngines);
+    }
+
+    // Called on the audio thread. Wait-free and doesn't free anything. Returns false
+    // if too many engines are waiting already, the engine is left untouched then.
+    bool recycle (std::unique_ptr<MultichannelEngine>& engine) noexcept
+    {
+        return returned.push (engine);
+    }
+
+    // The other functions are called by the factory, with its lock held. Engines
+    // that can't be reused are destroyed on the calling thread.
+
+    // Loads the impulse response into a free engine of the layout, and only builds
+    // a new one if there is none.
+    std::unique_ptr<MultichannelEngine> getEngine (const AudioBuffer<float>& buf, const MultichannelEngine::Layout& layout)
+    {
+        collectReturnedEngines();
+
+        // engines of another layout won't be used anymore
+        engines.erase (std::remove_if (engines.begin(), engines.end(), [&] (const auto& e) { return ! e->hasLayout (layout); }),
+                       engines.end());
+
+        std::unique_ptr<MultichannelEngine> result;
+
+        if (engines.empty())
+        {
+            result = std::make_unique<MultichannelEngine> (buf, layout);
+        }
+        else
+        {
+            result = std::move (engines.back());
+            engines.pop_back();
+            result->loadImpulseResponse (buf);
+        }
+
+        while ((int) engines.size() < numSpareEngines)
+            engines.push_back (std::make_unique<MultichannelEngine> (buf, layout));
+
+        return result;
+    }
+
+    // Takes an engine that is done with, e.g. one that was replaced before the audio
+    // thread picked it up.
+    void add (std::unique_ptr<MultichannelEngine> engine)
+    {
+        if (engine != nullptr
+            && engine->getImpulseResponseSet() == nullptr
+            && (int) engines.size() < maxNumEngines)
+        {
+            engines.push_back (std::move (engine));
+        }
+    }
+
+    void collectReturnedEngines()
+    {
+        returned.popAll ([this] (std::unique_ptr<MultichannelEngine>& engine) { add (std::move (engine)); });
+    }
+
+private:
+    // one engine is processed, one fades out and one waits to be picked up at most,
+    // two spare ones are enough to load the next impulse responses meanwhile
+    static constexpr int numSpareEngines = 2;
+    static constexpr int maxNumEngines = 8;
+
+    Queue<std::unique_ptr<MultichannelEngine>> returned;
+    std::vector<std::unique_ptr<MultichannelEngine>> engines;
+};
+
 // This class caches the data required to build a new convolution engine
 // (in particular, impulse response data and a ProcessSpec).
 // Calls to `setProcessSpec` and `setImpulseResponse` construct a
@@ -731,19 +1718,23 @@ class ConvolutionEngineFactory
 public:
     ConvolutionEngineFactory (Convolution::Latency requiredLatency,
                               Convolution::NonUniform requiredHeadSize)
-        : latency  { (requiredLatency.latencyInSamples   <= 0) ? 0 : jmax (64, nextPowerOfTwo (requiredLatency.latencyInSamples)) },
-          headSize { (requiredHeadSize.headSizeInSamples <= 0) ? 0 : jmax (64, nextPowerOfTwo (requiredHeadSize.headSizeInSamples)) },
-          shouldBeZeroLatency (requiredLatency.latencyInSamples == 0)
-    {}
+    {
+        applyProcessingMode (requiredLatency, requiredHeadSize);
+    }
 
+    // Builds the engines for the new spec and processing mode at once.
     // It is safe to call this method simultaneously with other public
     // member functions.
-    void setProcessSpec (const ProcessSpec& spec)
+    void setProcessSpec (const ProcessSpec& spec,
+                         Convolution::Latency requiredLatency,
+                         Convolution::NonUniform requiredHeadSize)
     {
         const std::lock_guard<std::mutex> lock (mutex);
         processSpec = spec;
+        hasProcessSpec = true;
+        applyProcessingMode (requiredLatency, requiredHeadSize);
 
-        engine.set (makeEngine());
+        updateEngines();
     }
 
     // It is safe to call this method simultaneously with other public
@@ -752,18 +1743,68 @@ public:
                              Convolution::Stereo stereo,
                              Convolution::Trim trim,
                              Convolution::Normalise normalise)
+    {
+        setImpulseResponse (buf.buffer, buf.sampleRate, stereo, trim, normalise);
+    }
+
+    // The buffer is only read, the factory keeps a copy.
+    void setImpulseResponse (const AudioBuffer<float>& buf,
+                             double bufferSampleRate,
+                             Convolution::Stereo stereo,
+                             Convolution::Trim trim,
+                             Convolution::Normalise normalise)
     {
         const std::lock_guard<std::mutex> lock (mutex);
         wantsNormalise = normalise;
-        originalSampleRate = buf.sampleRate;
+        originalSampleRate = bufferSampleRate;
 
         impulseResponse = [&]
         {
-            auto corrected = fixNumChannels (buf.buffer, stereo);
+            auto corrected = fixNumChannels (buf, stereo);
             return trim == Convolution::Trim::yes ? trimImpulseResponse (corrected) : corrected;
         }();
 
-        engine.set (makeEngine());
+        usesImpulseResponseSet = false;
+        impulseResponseSetData.setSize (0, 0);
+        impulseResponseSet.reset();
+
+        updateEngines();
+    }
+
+    // It is safe to call this method simultaneously with other public
+    // member functions.
+    void setImpulseResponseSet (BufferWithSampleRate&& buf, int generation)
+    {
+        const std::lock_guard<std::mutex> lock (mutex);
+        setGeneration = generation;
+        originalSetSampleRate = buf.sampleRate;
+        impulseResponseSetData = std::move (buf.buffer);
+        impulseResponseSet.reset();
+        usesImpulseResponseSet = impulseResponseSetData.getNumChannels() >= 2
+                              && impulseResponseSetData.getNumSamples() > 0;
+
+        updateEngines();
+    }
+
+    // It is safe to call this method simultaneously with other public
+    // member functions.
+    void setMonoInput (bool shouldUseMonoInput)
+    {
+        const std::lock_guard<std::mutex> lock (mutex);
+
+        if (std::exchange (isMonoInput, shouldUseMonoInput) != shouldUseMonoInput)
+            updateEngines();
+    }
+
+    // It is safe to call this method simultaneously with other public
+    // member functions.
+    void setProcessingMode (Convolution::Latency requiredLatency,
+                            Convolution::NonUniform requiredHeadSize)
+    {
+        const std::lock_guard<std::mutex> lock (mutex);
+
+        if (applyProcessingMode (requiredLatency, requiredHeadSize))
+            updateEngines();
     }
 
     // Returns the most recently-created engine, or nullptr
@@ -773,7 +1814,64 @@ public:
     // member functions.
     std::unique_ptr<MultichannelEngine> getEngine() { return engine.get(); }
 
+    // When an impulse response set is in use, a second engine bound to the same set
+    // is created alongside the main one, so that switching between entries of the
+    // set can be crossfaded without building anything.
+    std::unique_ptr<MultichannelEngine> getSpareEngine() { return spareEngine.get(); }
+
+    // Hands an engine that isn't needed anymore back for reuse, see
+    // ConvolutionEnginePool. Wait-free, for the audio thread.
+    bool recycleEngine (std::unique_ptr<MultichannelEngine>& engineToRecycle) noexcept
+    {
+        return pool.recycle (engineToRecycle);
+    }
+
 private:
+    // Returns true if the settings changed
+    bool applyProcessingMode (Convolution::Latency requiredLatency,
+                              Convolution::NonUniform requiredHeadSize)
+    {
+        const Convolution::Latency newLatency { (requiredLatency.latencyInSamples <= 0) ? 0 : jmax (64, nextPowerOfTwo (requiredLatency.latencyInSamples)) };
+        const Convolution::NonUniform newHeadSize { (requiredHeadSize.headSizeInSamples <= 0) ? 0 : jmax (64, nextPowerOfTwo (requiredHeadSize.headSizeInSamples)) };
+        const auto newShouldBeZeroLatency = requiredLatency.latencyInSamples == 0;
+
+        const auto changed = newLatency.latencyInSamples != latency.latencyInSamples
+                          || newHeadSize.headSizeInSamples != headSize.headSizeInSamples
+                          || newShouldBeZeroLatency != shouldBeZeroLatency;
+
+        latency = newLatency;
+        headSize = newHeadSize;
+        shouldBeZeroLatency = newShouldBeZeroLatency;
+
+        return changed;
+    }
+
+    void updateEngines()
+    {
+        pool.collectReturnedEngines();
+
+        if (! usesImpulseResponseSet)
+        {
+            pool.add (engine.set (makeEngine()));
+            return;
+        }
+
+        // Transforming a whole set is expensive, so we wait until we know the
+        // real processing spec before doing it.
+        if (! hasProcessSpec)
+            return;
+
+        engine.set (makeImpulseResponseSetEngine());
+        spareEngine.set (makeImpulseResponseSetEngine());
+    }
+
+    int getMaxBufferSize() const
+    {
+        const auto currentLatency = jmax (processSpec.maximumBlockSize, (uint32) latency.latencyInSamples);
+        return shouldBeZeroLatency ? static_cast<int> (processSpec.maximumBlockSize)
+                                   : nextPowerOfTwo (static_cast<int> (currentLatency));
+    }
+
     std::unique_ptr<MultichannelEngine> makeEngine()
     {
         auto resampled = resampleImpulseResponse (impulseResponse, originalSampleRate, processSpec.sampleRate);
@@ -783,15 +1881,47 @@ private:
         else
             resampled.applyGain ((float) (originalSampleRate / processSpec.sampleRate));
 
-        const auto currentLatency = jmax (processSpec.maximumBlockSize, (uint32) latency.latencyInSamples);
-        const auto maxBufferSize = shouldBeZeroLatency ? static_cast<int> (processSpec.maximumBlockSize)
-                                                       : nextPowerOfTwo (static_cast<int> (currentLatency));
+        const MultichannelEngine::Layout layout { resampled.getNumSamples(),
+                                                  static_cast<int> (processSpec.maximumBlockSize),
+                                                  getMaxBufferSize(),
+                                                  headSize,
+                                                  shouldBeZeroLatency,
+                                                  isMonoInput };
+
+        return pool.getEngine (resampled, layout);
+    }
+
+    std::unique_ptr<MultichannelEngine> makeImpulseResponseSetEngine()
+    {
+        const auto maxBufferSize = getMaxBufferSize();
+
+        if (impulseResponseSet == nullptr
+            || ! impulseResponseSet->matches (static_cast<size_t> (maxBufferSize), processSpec.sampleRate))
+        {
+            if (approximatelyEqual (originalSetSampleRate, processSpec.sampleRate))
+            {
+                impulseResponseSet = std::make_shared<const ImpulseResponseSet> (impulseResponseSetData,
+                                                                                 static_cast<size_t> (maxBufferSize),
+                                                                                 processSpec.sampleRate,
+                                                                                 setGeneration);
+            }
+            else
+            {
+                auto resampled = resampleImpulseResponse (impulseResponseSetData, originalSetSampleRate, processSpec.sampleRate);
+                resampled.applyGain ((float) (originalSetSampleRate / processSpec.sampleRate));
+
+                impulseResponseSet = std::make_shared<const ImpulseResponseSet> (resampled,
+                                                                                 static_cast<size_t> (maxBufferSize),
+                                                                                 processSpec.sampleRate,
+                                                                                 setGeneration);
+            }
+        }
 
-        return std::make_unique<MultichannelEngine> (resampled,
+        return std::make_unique<MultichannelEngine> (impulseResponseSet,
                                                      processSpec.maximumBlockSize,
                                                      maxBufferSize,
-                                                     headSize,
-                                                     shouldBeZeroLatency);
+                                                     shouldBeZeroLatency,
+                                                     isMonoInput);
     }
 
     static AudioBuffer<float> makeImpulseBuffer()
@@ -802,14 +1932,23 @@ private:
     }
 
     ProcessSpec processSpec { 44100.0, 128, 2 };
+    bool hasProcessSpec = false;
     AudioBuffer<float> impulseResponse = makeImpulseBuffer();
     double originalSampleRate = processSpec.sampleRate;
     Convolution::Normalise wantsNormalise = Convolution::Normalise::no;
-    const Convolution::Latency latency;
-    const Convolution::NonUniform headSize;
-    const bool shouldBeZeroLatency;
+    Convolution::Latency latency { 0 };
+    Convolution::NonUniform headSize { 0 };
+    bool shouldBeZeroLatency = true;
+    bool isMonoInput = false;
 
-    TryLockedPtr<MultichannelEngine> engine;
+    AudioBuffer<float> impulseResponseSetData;
+    double originalSetSampleRate = processSpec.sampleRate;
+    int setGeneration = 0;
+    std::shared_ptr<const ImpulseResponseSet> impulseResponseSet;
+    bool usesImpulseResponseSet = false;
+
+    TryLockedPtr<MultichannelEngine> engine, spareEngine;
+    ConvolutionEnginePool pool;
 
     mutable std::mutex mutex;
 };
@@ -850,7 +1989,10 @@ public:
     ConvolutionEngineQueue (BackgroundMessageQueue& queue,
                             Convolution::Latency latencyIn,
                             Convolution::NonUniform headSizeIn)
-        : messageQueue (queue), factory (latencyIn, headSizeIn) {}
+        : messageQueue (queue),
+          factory (latencyIn, headSizeIn),
+          requestedLatency (latencyIn.latencyInSamples),
+          requestedHeadSize (headSizeIn.headSizeInSamples) {}
 
     void loadImpulseResponse (AudioBuffer<float>&& buffer,
                               double sr,
@@ -864,6 +2006,64 @@ public:
         });
     }
 
+    // Copies the impulse response into one of the reserved buffers, the caller
+    // keeps its own. If it doesn't fit or all of them are in use, the buffer is
+    // taken over like above.
+    void loadImpulseResponseFrom (AudioBuffer<float>& buffer,
+                                  double sr,
+                                  Convolution::Stereo stereo,
+                                  Convolution::Trim trim,
+                                  Convolution::Normalise normalise)
+    {
+        int index = -1;
+
+        if (buffer.getNumChannels() <= reservedChannels && buffer.getNumSamples() <= reservedSamples)
+            freeImpulseBuffers.pop ([&] (int& i) { index = i; });
+
+        if (index < 0)
+        {
+            loadImpulseResponse (std::move (buffer), sr, stereo, trim, normalise);
+            return;
+        }
+
+        // smaller than reserved, so it keeps its allocation
+        auto& target = impulseBuffers[(size_t) index];
+        target.setSize (buffer.getNumChannels(), buffer.getNumSamples(), false, false, true);
+
+        for (int channel = 0; channel < buffer.getNumChannels(); ++channel)
+            target.copyFrom (channel, 0, buffer, channel, 0, buffer.getNumSamples());
+
+        callLater ([handle = ImpulseBufferHandle (weakFromThis(), index, impulseBufferGeneration.load()),
+                    sr, stereo, trim, normalise] (ConvolutionEngineFactory& f) mutable
+        {
+            if (auto t = handle.owner.lock())
+                f.setImpulseResponse (t->impulseBuffers[(size_t) handle.index], sr, stereo, trim, normalise);
+        });
+    }
+
+    // Allocates the buffers for loadImpulseResponseFrom(). Only call this while no
+    // command of this queue is in flight, e.g. after flushPendingCommand().
+    void reserveImpulseBuffers (int numChannels, int numSamples)
+    {
+        const SpinLock::ScopedLockType lock (freeImpulseBuffersLock);
+
+        // buffers held by replaced commands that are still queued aren't taken back
+        ++impulseBufferGeneration;
+        freeImpulseBuffers.popAll ([] (int&) {});
+
+        reservedChannels = numChannels;
+        reservedSamples = numSamples;
+
+        if (numChannels <= 0 || numSamples <= 0)
+            return;
+
+        for (int i = 0; i < numImpulseBuffers; ++i)
+        {
+            impulseBuffers[(size_t) i].setSize (numChannels, numSamples);
+            freeImpulseBuffers.push (i);
+        }
+    }
+
     void loadImpulseResponse (const void* sourceData,
                               size_t sourceDataSize,
                               Convolution::Stereo stereo,
@@ -889,35 +2089,161 @@ public:
         });
     }
 
+    void loadImpulseResponseSet (AudioBuffer<float>&& buffer, double sr, int generation)
+    {
+        callLater ([b = std::move (buffer), sr, generation] (ConvolutionEngineFactory& f) mutable
+        {
+            f.setImpulseResponseSet ({ std::move (b), sr }, generation);
+        });
+    }
+
     void prepare (const ProcessSpec& spec)
     {
-        factory.setProcessSpec (spec);
+        // A mode that is still waiting for the background thread is built right
+        // away, together with the new spec.
+        processingModePending.store (false);
+        factory.setProcessSpec (spec, { requestedLatency.load() }, { requestedHeadSize.load() });
+    }
+
+    void setMonoInput (bool shouldUseMonoInput)
+    {
+        factory.setMonoInput (shouldUseMonoInput);
+    }
+
+    // Only stores the mode, the engines are rebuilt on the background thread once
+    // postPendingCommand() gets to it. Wait-free, may be called from any thread.
+    void setProcessingMode (Convolution::Latency requiredLatency, Convolution::NonUniform requiredHeadSize)
+    {
+        requestedLatency.store (requiredLatency.latencyInSamples);
+        requestedHeadSize.store (requiredHeadSize.headSizeInSamples);
+        processingModePending.store (true);
     }
 
     // Call this regularly to try to resend any pending message.
     // This allows us to always apply the most recently requested
     // state (eventually), even if the message queue fills up.
+    // Only one command per queue is in flight at a time, newer requests replace
+    // the pending one meanwhile, so a Convolution that is updated very often
+    // can't crowd out the others sharing the message queue.
     void postPendingCommand()
     {
-        if (pendingCommand == nullptr)
+        postProcessingMode();
+
+        if (pendingCommand == nullptr || commandInFlight.load())
             return;
 
+        commandInFlight.store (true);
+        sentCommandId.store (pendingCommandId);
+
         if (messageQueue.push (pendingCommand))
+        {
             pendingCommand = nullptr;
+        }
+        else
+        {
+            sentCommandId.store (0);
+            commandInFlight.store (false);
+        }
+    }
+
+    // Runs the pending command on the calling thread, after the one that was sent
+    // has finished on the background thread. Only the commands of this queue are
+    // run, the shared message queue may also hold those of other Convolutions.
+    void flushPendingCommand()
+    {
+        while (commandInFlight.load())
+            Thread::sleep (1);
+
+        if (pendingCommand == nullptr)
+            return;
+
+        commandInFlight.store (true);
+        sentCommandId.store (pendingCommandId);
+        pendingCommand();
+        pendingCommand = nullptr;
     }
 
     std::unique_ptr<MultichannelEngine> getEngine() { return factory.getEngine(); }
+    std::unique_ptr<MultichannelEngine> getSpareEngine() { return factory.getSpareEngine(); }
+    bool recycleEngine (std::unique_ptr<MultichannelEngine>& engine) noexcept { return factory.recycleEngine (engine); }
 
 private:
+    // Hands a reserved buffer back once the command holding it is destroyed,
+    // whether it ran or was replaced.
+    struct ImpulseBufferHandle
+    {
+        ImpulseBufferHandle (std::weak_ptr<ConvolutionEngineQueue> ownerIn, int indexIn, uint32 generationIn)
+            : owner (std::move (ownerIn)), index (indexIn), generation (generationIn) {}
+
+        ImpulseBufferHandle (ImpulseBufferHandle&& other) noexcept
+            : owner (std::move (other.owner)), index (std::exchange (other.index, -1)), generation (other.generation) {}
+
+        ImpulseBufferHandle& operator= (ImpulseBufferHandle&&) = delete;
+
+        ~ImpulseBufferHandle()
+        {
+            if (index >= 0)
+                if (auto t = owner.lock())
+                    t->releaseImpulseBuffer (index, generation);
+        }
+
+        std::weak_ptr<ConvolutionEngineQueue> owner;
+        int index = -1;
+        uint32 generation = 0;
+    };
+
+    // Usually called on the background thread, on the audio thread only if the
+    // message queue was full. A buffer that can't be handed back right now stays
+    // unused until the next reserveImpulseBuffers().
+    void releaseImpulseBuffer (int index, uint32 generation)
+    {
+        const SpinLock::ScopedTryLockType lock (freeImpulseBuffersLock);
+
+        if (lock.isLocked() && generation == impulseBufferGeneration.load())
+            freeImpulseBuffers.push (index);
+    }
+
+    // Sent apart from the pending command, so that it can't replace an impulse
+    // response that is waiting to be loaded. The command reads the most recent
+    // mode when it runs.
+    void postProcessingMode()
+    {
+        if (! processingModePending.exchange (false))
+            return;
+
+        BackgroundMessageQueue::IncomingCommand command = [weak = weakFromThis()]
+        {
+            if (auto t = weak.lock())
+                t->factory.setProcessingMode ({ t->requestedLatency.load() }, { t->requestedHeadSize.load() });
+        };
+
+        if (! messageQueue.push (command))
+            processingModePending.store (true);
+    }
+
     template <typename Fn>
     void callLater (Fn&& fn)
     {
-        // If there was already a pending command (because the queue was full) we'll end up deleting it here.
-        // Not much we can do about that!
-        pendingCommand = [weak = weakFromThis(), callback = std::forward<Fn> (fn)]() mutable
+        // A pending command that gets replaced may own e.g. the buffer of an impulse
+        // response, so it is sent to the background thread just to be destroyed
+        // there. Only the command that postPendingCommand() sent runs its callback.
+        // If the queue is full as well, we'll end up deleting it here. Not much we
+        // can do about that!
+        if (pendingCommand != nullptr)
+            messageQueue.push (pendingCommand);
+
+        const auto id = ++pendingCommandId;
+
+        pendingCommand = [weak = weakFromThis(), callback = std::forward<Fn> (fn), id]() mutable
         {
             if (auto t = weak.lock())
+            {
+                if (t->sentCommandId.load() != id)
+                    return;
+
                 callback (t->factory);
+                t->commandInFlight.store (false);
+            }
         };
 
         postPendingCommand();
@@ -928,6 +2254,19 @@ private:
     BackgroundMessageQueue& messageQueue;
     ConvolutionEngineFactory factory;
     BackgroundMessageQueue::IncomingCommand pendingCommand;
+    uint32 pendingCommandId = 0;
+    std::atomic<uint32> sentCommandId { 0 };
+    std::atomic<bool> commandInFlight { false };
+    std::atomic<int> requestedLatency, requestedHeadSize;
+    std::atomic<bool> processingModePending { false };
+
+    // one is loaded, one is pending and a few are held by replaced commands
+    static constexpr int numImpulseBuffers = 6;
+    std::array<AudioBuffer<float>, numImpulseBuffers> impulseBuffers;
+    Queue<int> freeImpulseBuffers { numImpulseBuffers + 1 };
+    SpinLock freeImpulseBuffersLock;
+    std::atomic<uint32> impulseBufferGeneration { 0 };
+    int reservedChannels = 0, reservedSamples = 0;
 };
 
 class CrossoverMixer
@@ -940,8 +2279,7 @@ public:
 
     void prepare (const ProcessSpec& spec)
     {
-        smoother.reset (spec.sampleRate, 0.1);
-        smootherBuffer.setSize (1, static_cast<int> (spec.maximumBlockSize));
+        gainBuffer.setSize (2, static_cast<int> (spec.maximumBlockSize));
         mixBuffer.setSize (static_cast<int> (spec.numChannels), static_cast<int> (spec.maximumBlockSize));
         reset();
     }
@@ -956,9 +2294,11 @@ public:
         if (smoother.isSmoothing())
         {
             const auto numSamples = static_cast<int> (input.getNumSamples());
+            auto* previousGains = gainBuffer.getWritePointer (0);
+            auto* currentGains  = gainBuffer.getWritePointer (1);
 
             for (auto sample = 0; sample != numSamples; ++sample)
-                smootherBuffer.setSample (0, sample, smoother.getNextValue());
+                getTransitionGains (curve, 1.0f - smoother.getNextValue(), previousGains[sample], currentGains[sample]);
 
             AudioBlock<float> mixBlock (mixBuffer);
             mixBlock.clear();
@@ -967,19 +2307,16 @@ public:
             for (size_t channel = 0; channel != output.getNumChannels(); ++channel)
             {
                 FloatVectorOperations::multiply (mixBlock.getChannelPointer (channel),
-                                                 smootherBuffer.getReadPointer (0),
+                                                 previousGains,
                                                  numSamples);
             }
 
-            FloatVectorOperations::multiply (smootherBuffer.getWritePointer (0), -1.0f, numSamples);
-            FloatVectorOperations::add (smootherBuffer.getWritePointer (0), 1.0f, numSamples);
-
             current (input, output);
 
             for (size_t channel = 0; channel != output.getNumChannels(); ++channel)
             {
                 FloatVectorOperations::multiply (output.getChannelPointer (channel),
-                                                 smootherBuffer.getReadPointer (0),
+                                                 currentGains,
                                                  numSamples);
                 FloatVectorOperations::add (output.getChannelPointer (channel),
                                             mixBlock.getChannelPointer (channel),
@@ -995,15 +2332,18 @@ public:
         }
     }
 
-    void beginTransition()
+    void beginTransition (int numSamples, Convolution::TransitionCurve newCurve)
     {
+        curve = newCurve;
+        smoother.reset (jmax (1, numSamples));
         smoother.setCurrentAndTargetValue (1.0f);
         smoother.setTargetValue (0.0f);
     }
 
 private:
     LinearSmoothedValue<float> smoother;
-    AudioBuffer<float> smootherBuffer;
+    Convolution::TransitionCurve curve = Convolution::TransitionCurve::linear;
+    AudioBuffer<float> gainBuffer;
     AudioBuffer<float> mixBuffer;
 };
 
@@ -1028,28 +2368,61 @@ public:
         if (currentEngine != nullptr)
             currentEngine->reset();
 
-        destroyPreviousEngine();
+        retirePreviousEngine();
     }
 
     void prepare (const ProcessSpec& spec)
     {
-        messageQueue->pimpl->popAll();
+        engineQueue->flushPendingCommand();
+        engineQueue->reserveImpulseBuffers (reservedChannels, reservedSamples);
         mixer.prepare (spec);
         engineQueue->prepare (spec);
+        sampleRate = spec.sampleRate;
 
         if (auto newEngine = engineQueue->getEngine())
             currentEngine = std::move (newEngine);
 
+        if (auto newSpareEngine = engineQueue->getSpareEngine())
+            spareEngine = std::move (newSpareEngine);
+
         previousEngine = nullptr;
         jassert (currentEngine != nullptr);
+
+        if (currentEngine != nullptr)
+            installedLatency = currentEngine->getLatency();
+
+        if (currentEngine != nullptr && currentEngine->getImpulseResponseSet() != nullptr)
+            currentEngine->selectImpulseResponses (selection);
+    }
+
+    void setMonoInput (bool shouldUseMonoInput)
+    {
+        isMonoInput = shouldUseMonoInput;
+        engineQueue->setMonoInput (shouldUseMonoInput);
+    }
+
+    void setCrossfade (Crossfade newCrossfade) noexcept
+    {
+        crossfade = newCrossfade;
+    }
+
+    void setTransition (double seconds, TransitionCurve curve) noexcept
+    {
+        transitionTime = jmax (0.0, seconds);
+        transitionCurve = curve;
     }
 
     void processSamples (const AudioBlock<const float>& input, AudioBlock<float>& output)
     {
         engineQueue->postPendingCommand();
+        sendParkedCommands();
+        installPendingSpareEngine();
 
         if (previousEngine == nullptr)
+        {
             installPendingEngine();
+            installSelectedImpulseResponse ((int) input.getNumSamples());
+        }
 
         mixer.processSamples (input,
                               output,
@@ -1060,16 +2433,37 @@ public:
                               [this] (const AudioBlock<const float>& in, AudioBlock<float>& out)
                               {
                                   if (previousEngine != nullptr)
+                                  {
                                       previousEngine->processSamples (in, out);
+                                  }
                                   else
+                                  {
                                       out.copyFrom (in);
+
+                                      if (isMonoInput)
+                                          for (size_t channel = 1; channel < out.getNumChannels(); ++channel)
+                                              out.getSingleChannelBlock (channel).copyFrom (in.getSingleChannelBlock (0));
+                                  }
                               },
-                              [this] { destroyPreviousEngine(); });
+                              [this] { retirePreviousEngine(); });
     }
 
     int getCurrentIRSize() const { return currentEngine != nullptr ? currentEngine->getIRSize() : 0; }
 
-    int getLatency() const { return currentEngine != nullptr ? currentEngine->getLatency() : 0; }
+    int getLatency() const { return installedLatency.load(); }
+
+    int getNumTransitions() const noexcept { return numTransitions; }
+
+    int getImpulseResponseSetGeneration() const noexcept
+    {
+        const auto* set = currentEngine != nullptr ? currentEngine->getImpulseResponseSet() : nullptr;
+        return set != nullptr ? set->getGeneration() : -1;
+    }
+
+    void setProcessingMode (Latency requiredLatency, NonUniform requiredHeadSize)
+    {
+        engineQueue->setProcessingMode (requiredLatency, requiredHeadSize);
+    }
 
     void loadImpulseResponse (AudioBuffer<float>&& buffer,
                               double originalSampleRate,
@@ -1080,6 +2474,21 @@ public:
         engineQueue->loadImpulseResponse (std::move (buffer), originalSampleRate, stereo, trim, normalise);
     }
 
+    void loadImpulseResponseFrom (AudioBuffer<float>& buffer,
+                                  double originalSampleRate,
+                                  Stereo stereo,
+                                  Trim trim,
+                                  Normalise normalise)
+    {
+        engineQueue->loadImpulseResponseFrom (buffer, originalSampleRate, stereo, trim, normalise);
+    }
+
+    void reserveImpulseResponses (int numChannels, int numSamples)
+    {
+        reservedChannels = numChannels;
+        reservedSamples = numSamples;
+    }
+
     void loadImpulseResponse (const void* sourceData,
                               size_t sourceDataSize,
                               Stereo stereo,
@@ -1099,32 +2508,180 @@ public:
         engineQueue->loadImpulseResponse (fileImpulseResponse, stereo, trim, size, normalise);
     }
 
+    void loadImpulseResponseSet (AudioBuffer<float>&& buffer, double originalSampleRate, int generation)
+    {
+        engineQueue->loadImpulseResponseSet (std::move (buffer), originalSampleRate, generation);
+    }
+
+    void selectImpulseResponses (const ImpulseResponseSelection& newSelection) noexcept
+    {
+        selection = newSelection;
+    }
+
 private:
-    void destroyPreviousEngine()
+    void destroyEngine (std::unique_ptr<MultichannelEngine>& engine)
     {
-        // If the queue is full, we'll destroy this straight away
-        BackgroundMessageQueue::IncomingCommand command = [p = std::move (previousEngine)]() mutable { p = nullptr; };
+        if (engine == nullptr)
+            return;
+
+        // Reused for a later impulse response if possible, the pool frees it otherwise
+        if (engineQueue->recycleEngine (engine))
+            return;
+
+        // Otherwise it is freed on the background thread. A command the message
+        // queue can't take right now stays parked, and is sent again with the
+        // next block.
+        for (auto& parked : parkedCommands)
+        {
+            if (parked != nullptr)
+                continue;
+
+            parked = [p = std::move (engine)]() mutable { p = nullptr; };
+            sendParkedCommands();
+            return;
+        }
+
+        // If every slot is taken as well, we'll destroy this straight away
+        BackgroundMessageQueue::IncomingCommand command = [p = std::move (engine)]() mutable { p = nullptr; };
         messageQueue->pimpl->push (command);
     }
 
+    void sendParkedCommands()
+    {
+        for (auto& parked : parkedCommands)
+            if (parked != nullptr && messageQueue->pimpl->push (parked))
+                parked = nullptr;
+    }
+
+    void destroyPreviousEngine()
+    {
+        destroyEngine (previousEngine);
+    }
+
+    // Once a transition between two entries of the same impulse response set is
+    // done, the old engine is kept around for the next switch instead of being
+    // destroyed.
+    void retirePreviousEngine()
+    {
+        const auto* set = currentEngine != nullptr ? currentEngine->getImpulseResponseSet() : nullptr;
+
+        if (spareEngine == nullptr
+            && set != nullptr
+            && previousEngine != nullptr
+            && previousEngine->getImpulseResponseSet() == set)
+        {
+            spareEngine = std::move (previousEngine);
+            return;
+        }
+
+        destroyPreviousEngine();
+    }
+
     void installNewEngine (std::unique_ptr<MultichannelEngine> newEngine)
     {
         destroyPreviousEngine();
+
+        // A crossfade between engines of different latency would play the signal
+        // twice, once for each latency, so a new processing mode takes over at once.
+        if (currentEngine != nullptr && currentEngine->getLatency() != newEngine->getLatency())
+        {
+            destroyEngine (currentEngine);
+            currentEngine = std::move (newEngine);
+            installedLatency = currentEngine->getLatency();
+            mixer.reset();
+            return;
+        }
+
         previousEngine = std::move (currentEngine);
         currentEngine = std::move (newEngine);
-        mixer.beginTransition();
+        mixer.beginTransition (getTransitionLength(), transitionCurve);
+        ++numTransitions;
     }
 
     void installPendingEngine()
     {
         if (auto newEngine = engineQueue->getEngine())
+        {
+            if (newEngine->getImpulseResponseSet() != nullptr)
+                newEngine->selectImpulseResponses (selection);
+
             installNewEngine (std::move (newEngine));
+        }
+    }
+
+    void installPendingSpareEngine()
+    {
+        if (auto newSpareEngine = engineQueue->getSpareEngine())
+        {
+            destroyEngine (spareEngine);
+            spareEngine = std::move (newSpareEngine);
+        }
+    }
+
+    // Switches to another entry of the current impulse response set, either by
+    // crossfading into the spare engine, which reads from the same precomputed
+    // spectra, or by crossfading the spectra inside the current engine.
+    void installSelectedImpulseResponse (int numSamples)
+    {
+        const auto* set = currentEngine != nullptr ? currentEngine->getImpulseResponseSet() : nullptr;
+
+        // a selection made for a set that isn't installed yet waits for its engine
+        if (set == nullptr || selection.generation != set->getGeneration() || currentEngine->getSelection() == selection)
+            return;
+
+        if (crossfade == Crossfade::spectra)
+        {
+            if (currentEngine->crossfadeToImpulseResponses (selection, getTransitionLength(), transitionCurve))
+                ++numTransitions;
+
+            return;
+        }
+
+        if (crossfade == Crossfade::morph)
+        {
+            // over this block, so that the next selection can follow right away. An
+            // engine with latency blends the spectra once per internal block, which
+            // needs at least one step of its own.
+            const auto morphLength = jmax (numSamples, 2 * currentEngine->getLatency());
+            if (currentEngine->crossfadeToImpulseResponses (selection, morphLength, TransitionCurve::linear, true))
+                ++numTransitions;
+
+            return;
+        }
+
+        if (spareEngine == nullptr || spareEngine->getImpulseResponseSet() != set)
+            return;
+
+        if (! spareEngine->selectImpulseResponses (selection))
+            return;
+
+        spareEngine->reset();
+        previousEngine = std::move (currentEngine);
+        currentEngine = std::move (spareEngine);
+        mixer.beginTransition (getTransitionLength(), transitionCurve);
+        ++numTransitions;
+    }
+
+    int getTransitionLength() const noexcept
+    {
+        return jmax (1, roundToInt (sampleRate * transitionTime));
     }
 
     OptionalQueue messageQueue;
     std::shared_ptr<ConvolutionEngineQueue> engineQueue;
-    std::unique_ptr<MultichannelEngine> previousEngine, currentEngine;
+    std::unique_ptr<MultichannelEngine> previousEngine, currentEngine, spareEngine;
+    bool isMonoInput = false;
+    int numTransitions = 0;
+    Crossfade crossfade = Crossfade::engines;
+    double sampleRate = 44100.0, transitionTime = 0.1;
+    TransitionCurve transitionCurve = TransitionCurve::linear;
     CrossoverMixer mixer;
+    ImpulseResponseSelection selection = ImpulseResponseSelection::single (0, 0);
+    int reservedChannels = 0, reservedSamples = 0;
+    // of the engine that is processed, read by getLatency() from any thread
+    std::atomic<int> installedLatency { 0 };
+    // engines to be freed on the background thread, see destroyEngine()
+    std::array<BackgroundMessageQueue::IncomingCommand, 4> parkedCommands;
 };
 
 //==============================================================================
@@ -1259,6 +2816,75 @@ void Convolution::loadImpulseResponse (AudioBuffer<float>&& buffer,
     pimpl->loadImpulseResponse (std::move (buffer), originalSampleRate, stereo, trim, normalise);
 }
 
+void Convolution::loadImpulseResponseFrom (AudioBuffer<float>& buffer,
+                                           double originalSampleRate,
+                                           Stereo stereo,
+                                           Trim trim,
+                                           Normalise normalise)
+{
+    pimpl->loadImpulseResponseFrom (buffer, originalSampleRate, stereo, trim, normalise);
+}
+
+void Convolution::reserveImpulseResponses (int numChannels, int numSamples)
+{
+    pimpl->reserveImpulseResponses (numChannels, numSamples);
+}
+
+void Convolution::loadImpulseResponseSet (AudioBuffer<float>&& buffer, double originalSampleRate, int generation)
+{
+    pimpl->loadImpulseResponseSet (std::move (buffer), originalSampleRate, generation);
+}
+
+void Convolution::selectImpulseResponse (int index, int generation) noexcept
+{
+    pimpl->selectImpulseResponses (ImpulseResponseSelection::single (index, generation));
+}
+
+void Convolution::selectImpulseResponses (const int* indices, const float* weights, int numImpulseResponses, int generation) noexcept
+{
+    ImpulseResponseSelection selection;
+    selection.numEntries = jlimit (0, ImpulseResponseSelection::maxEntries, numImpulseResponses);
+    selection.generation = generation;
+
+    for (int i = 0; i < selection.numEntries; ++i)
+    {
+        selection.indices[i] = indices[i];
+        selection.weights[i] = weights[i];
+    }
+
+    pimpl->selectImpulseResponses (selection);
+}
+
+void Convolution::setMonoInput (bool shouldUseMonoInput)
+{
+    pimpl->setMonoInput (shouldUseMonoInput);
+}
+
+void Convolution::setProcessingMode (const Latency& requiredLatency, const NonUniform& requiredHeadSize)
+{
+    pimpl->setProcessingMode (requiredLatency, requiredHeadSize);
+}
+
+void Convolution::setCrossfade (Crossfade crossfade) noexcept
+{
+    pimpl->setCrossfade (crossfade);
+}
+
+void Convolution::setTransition (double seconds, TransitionCurve curve) noexcept
+{
+    pimpl->setTransition (seconds, curve);
+}
+
+int Convolution::getNumTransitions() const noexcept
+{
+    return pimpl->getNumTransitions();
+}
+
+int Convolution::getImpulseResponseSetGeneration() const noexcept
+{
+    return pimpl->getImpulseResponseSetGeneration();
+}
+
 void Convolution::prepare (const ProcessSpec& spec)
 {
     mixer.prepare (spec);
@@ -34,7 +34,9 @@ namespace custom_juce
     Used by the Convolution to dispatch engine-update messages on a background
     thread.
 
-    May be shared between multiple Convolution instances.
+    May be shared between multiple Convolution instances, also when they are
+    processed on different threads, e.g. a single queue for all instances of a
+    plugin held through a SharedResourcePointer.
 
     @tags{DSP}
 */
@@ -85,7 +87,9 @@ private:
     object having the samples of the impulse response as its coefficients.
     However, in general it is more efficient to do frequency domain
     convolution when the size of the impulse response is 64 samples or
-    greater.
+    greater. Short impulse responses loaded with zero latency are therefore
+    convolved in the time domain instead, when that is cheaper for the
+    prepared block size.
 
     Note: The default operation of this class uses zero latency and a uniform
     partitioned algorithm. If the impulse response size is large, or if the
@@ -183,6 +187,35 @@ public:
     /** Resets the processing pipeline ready to start a new stream of data. */
     void reset() noexcept;
 
+    /** Makes the convolution read only the first channel of its input, and
+        convolve it with both channels of a stereo impulse response, e.g. for
+        binaural rendering of a mono source. The input block may still have two
+        channels, the second one is ignored.
+
+        Both output channels then share a single forward FFT and a single input
+        delay line, which halves the transform work and input memory.
+
+        This rebuilds the convolution engines, so it should be called before
+        prepare() and not from the audio thread.
+    */
+    void setMonoInput (bool shouldUseMonoInput);
+
+    /** Switches between the processing modes of the constructors at runtime: a
+        Latency of 0 for zero latency, a positive Latency for a uniform partition
+        of that block size. A positive NonUniform head size additionally splits
+        the impulse response into a head of that size, processed in the small
+        blocks, and a tail processed in blocks of the head size. Engines built for
+        an impulse response set are always uniformly partitioned.
+
+        The engines are rebuilt on the background thread, like for a newly loaded
+        impulse response, so this function is wait-free and can be called from any
+        thread. getLatency() reports the latency of the new mode once process()
+        has installed an engine built for it, so it should be checked again after
+        process() to pass it on to the host. An engine with another latency
+        replaces the previous one without a crossfade.
+    */
+    void setProcessingMode (const Latency& requiredLatency, const NonUniform& requiredHeadSize);
+
     /** Performs the filter operation on the given set of samples with optional
         stereo processing.
     */
@@ -198,6 +231,44 @@ public:
     enum class Trim      { no, yes };
     enum class Normalise { no, yes };
 
+    /** How changes between entries of an impulse response set are crossfaded.
+
+        With engines, the old and the new entries are processed by two complete
+        convolution engines during the transition, and their outputs are mixed.
+
+        With spectra, a single engine multiplies its input spectra with both the old
+        and the new entries, and only the mix goes through the inverse FFT. This
+        costs one extra complex multiply-accumulate per channel instead of a second
+        engine, which matters when the selection changes all the time (e.g. a
+        moving source). The mix changes once per internal block instead of every
+        sample. If the selection changes again during a transition, the newest one
+        is faded in once the transition is done.
+
+        With morph, a single engine interpolates linearly between the old and the
+        new entries over the block in which the selection changed, sample by
+        sample. Both products of the input spectra go through their own inverse
+        FFT and the outputs are crossfaded. From the next internal block of the
+        engine on, this is a linear interpolation between the two filters. In the
+        block in which the transition starts, the new output still holds the older
+        partitions and the overlap of the old filter, since those were summed
+        before the change. The next block can then move on to
+        the next selection, so a source that moves in every block is rendered as
+        a filter that varies within the block, for one extra inverse FFT per
+        channel and no second engine. setTransition() doesn't apply. With a
+        latency, the spectra are blended instead, over two internal blocks.
+
+        Loading a new impulse response or set always crossfades engines.
+    */
+    enum class Crossfade { engines, spectra, morph };
+
+    /** The shape of the crossfades between impulse responses.
+
+        A linear crossfade keeps the level constant when both impulse responses are
+        similar, e.g. neighbouring HRIRs, an equal power one when their outputs are
+        uncorrelated, e.g. very different impulse responses.
+    */
+    enum class TransitionCurve { linear, equalPower };
+
     //==============================================================================
     /** This function loads an impulse response audio file from memory, added in a
         JUCE project with the Projucer as binary data. It can load any of the audio
@@ -257,10 +328,113 @@ public:
     void loadImpulseResponse (AudioBuffer<float>&& buffer, double bufferSampleRate,
                               Stereo isStereo, Trim requiresTrimming, Normalise requiresNormalisation);
 
+    /** Like the overload above, but the impulse response is copied into a buffer
+        the convolution reserved with reserveImpulseResponses(), so the caller keeps
+        its buffer and its allocation. This is wait-free as long as the impulse
+        response fits into the reserved size and a reserved buffer is free.
+        Otherwise the buffer is taken over like above and is left empty.
+    */
+    void loadImpulseResponseFrom (AudioBuffer<float>& buffer, double bufferSampleRate,
+                                  Stereo isStereo, Trim requiresTrimming, Normalise requiresNormalisation);
+
+    /** Sets the size of the buffers loadImpulseResponseFrom() copies into. They
+        are allocated by the next call to prepare().
+    */
+    void reserveImpulseResponses (int numChannels, int numSamples);
+
+    /** This function loads a whole set of stereo impulse responses from an audio
+        buffer, for example all the measurement positions of an HRTF dataset.
+        Channels 2 * i and 2 * i + 1 hold the left and right impulse response of
+        entry i, and all entries must have the same length.
+
+        Every entry is partitioned and transformed into the frequency domain once,
+        when the set is loaded (or when prepare() is called with a new block size),
+        so that selectImpulseResponse() can later switch between entries without
+        building a new convolution engine. Impulse responses of a set are never
+        trimmed or normalised, and are always processed with uniform partitioning.
+
+        Like the other overload taking an AudioBuffer, this function takes ownership
+        of the buffer passed in. Loading a single impulse response afterwards
+        releases the set.
+
+        The set is built on the background thread, so the engine processing the
+        previous set stays in use for a while. Selections carry the generation of
+        the set their indices belong to, and are only applied by an engine built
+        for the same generation.
+
+        @param buffer                   the AudioBuffer holding the set
+        @param bufferSampleRate         the sampleRate of the data in the AudioBuffer
+        @param generation               any number that tells this set apart from
+                                        the previous one
+    */
+    void loadImpulseResponseSet (AudioBuffer<float>&& buffer, double bufferSampleRate, int generation = 0);
+
+    /** Selects the entry of the impulse response set loaded with
+        loadImpulseResponseSet() that should be used for processing. The change is
+        crossfaded like any other impulse response change.
+
+        The selection waits until the set of the given generation is in use, and
+        is dropped if another selection is made meanwhile.
+
+        This function is wait-free and doesn't allocate, but must be called from
+        the same thread as process().
+    */
+    void selectImpulseResponse (int index, int generation = 0) noexcept;
+
+    /** Like selectImpulseResponse(), but uses a weighted blend of up to three
+        entries of the impulse response set, for example the corners of the
+        triangle around a direction in an HRTF dataset. The blend is done on the
+        precomputed spectra, so no FFT is needed.
+
+        This function is wait-free and doesn't allocate, but must be called from
+        the same thread as process().
+    */
+    void selectImpulseResponses (const int* indices, const float* weights, int numImpulseResponses, int generation = 0) noexcept;
+
+    /** Returns the generation of the impulse response set that is processed right
+        now, or -1 if there is none. Whatever goes with a selection outside of the
+        convolution, like the delays of an HRTF, should switch once this matches.
+
+        This function is wait-free, but must be called from the same thread as
+        process().
+    */
+    int getImpulseResponseSetGeneration() const noexcept;
+
+    /** Chooses how selectImpulseResponse() and selectImpulseResponses() crossfade,
+        see Crossfade. The default is Crossfade::engines.
+
+        This function is wait-free, but must be called before prepare() or from
+        the same thread as process().
+    */
+    void setCrossfade (Crossfade crossfade) noexcept;
+
+    /** Sets the length and the shape of the crossfades between impulse responses,
+        both for loading and for selecting them. The default is 100 ms, linear.
+
+        A transition that is already running keeps its length, the new one applies
+        from the next change on. As long as a crossfade between engines runs, newly
+        loaded impulse responses have to wait, so shorter transitions follow fast
+        changes more closely.
+
+        This function is wait-free, but must be called before prepare() or from
+        the same thread as process(), e.g. right before each selection.
+    */
+    void setTransition (double seconds, TransitionCurve curve) noexcept;
+
+    /** Returns how many transitions process() has started so far. A selection
+        or a load only takes effect once the running transition is done, so this
+        tells the caller when the last setTransition() was actually used.
+
+        This function is wait-free, but must be called from the same thread as
+        process().
+    */
+    int getNumTransitions() const noexcept;
+
     /** This function returns the size of the current IR in samples. */
     int getCurrentIRSize() const;
 
-    /** This function returns the current latency of the process in samples.
+    /** This function returns the latency of the process in samples, of the
+        engine that is processed right now. It may be called from any thread.
 
         Note: This is the latency of the convolution engine, not the latency
         associated with the current impulse response choice that has to be
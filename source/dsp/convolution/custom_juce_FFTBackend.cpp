@@ -0,0 +1,259 @@
+#include "custom_juce_FFTBackend.h"
+
+#include <map>
+
+#ifndef CUSTOM_JUCE_USE_FFTW
+ #define CUSTOM_JUCE_USE_FFTW 0
+#endif
+
+#if CUSTOM_JUCE_USE_FFTW
+ #include <fftw3.h>
+#endif
+
+namespace custom_juce
+{
+
+//==============================================================================
+class JuceFFTBackend final : public FFTBackend
+{
+public:
+    explicit JuceFFTBackend (int orderIn)
+        : FFTBackend (orderIn), fft (orderIn) {}
+
+    void performRealOnlyForwardTransform (float* data) const noexcept override
+    {
+       #if JUCE_IPP_AVAILABLE
+        const juce::SpinLock::ScopedLockType sl (lock);
+       #endif
+        fft.performRealOnlyForwardTransform (data, true);
+    }
+
+    void performRealOnlyInverseTransform (float* data) const noexcept override
+    {
+       #if JUCE_IPP_AVAILABLE
+        const juce::SpinLock::ScopedLockType sl (lock);
+       #endif
+        fft.performRealOnlyInverseTransform (data);
+    }
+
+private:
+    const juce::dsp::FFT fft;
+
+   #if JUCE_IPP_AVAILABLE
+    // the IPP engine of juce::dsp::FFT has a single work buffer, the others are
+    // reentrant (or lock internally). Never contended, as these objects aren't
+    // shared between engines, see getShared().
+    mutable juce::SpinLock lock;
+   #endif
+};
+
+#if CUSTOM_JUCE_USE_FFTW
+//==============================================================================
+// The planner of FFTW isn't thread safe, only executing plans is.
+struct FFTWPlanner
+{
+    juce::CriticalSection lock;
+    juce::File wisdomFile;
+    bool wisdomLoaded = false;
+};
+
+static FFTWPlanner& getPlanner()
+{
+    static FFTWPlanner planner;
+    return planner;
+}
+
+// The plans transform in place, and are executed on the caller's data with
+// FFTW's new-array functions, so that one object can be used by several threads
+// at once. Data that doesn't have the alignment of FFTW's own buffers goes
+// through a second pair of plans, which don't rely on it.
+class FFTWBackend final : public FFTBackend
+{
+public:
+    explicit FFTWBackend (int orderIn)
+        : FFTBackend (orderIn),
+          size (getSize())
+    {
+        auto& planner = getPlanner();
+        const juce::ScopedLock sl (planner.lock);
+
+        if (! planner.wisdomLoaded && planner.wisdomFile.existsAsFile())
+            fftwf_import_wisdom_from_filename (planner.wisdomFile.getFullPathName().toRawUTF8());
+
+        planner.wisdomLoaded = true;
+
+        // only for planning, in place transforms need the room of the bins
+        auto* buffer = fftwf_alloc_real ((size_t) size + 2);
+        auto* spectrum = reinterpret_cast<fftwf_complex*> (buffer);
+        alignment = fftwf_alignment_of (buffer);
+
+        bool measured = false;
+
+        const auto makePlans = [&] (unsigned flags, fftwf_plan& forward, fftwf_plan& inverse)
+        {
+            // only measures the sizes the wisdom doesn't know yet
+            forward = fftwf_plan_dft_r2c_1d (size, buffer, spectrum, flags | FFTW_WISDOM_ONLY);
+            inverse = fftwf_plan_dft_c2r_1d (size, spectrum, buffer, flags | FFTW_WISDOM_ONLY);
+
+            if (forward == nullptr || inverse == nullptr)
+                measured = true;
+
+            if (forward == nullptr)
+                forward = fftwf_plan_dft_r2c_1d (size, buffer, spectrum, flags);
+
+            if (inverse == nullptr)
+                inverse = fftwf_plan_dft_c2r_1d (size, spectrum, buffer, flags);
+        };
+
+        makePlans (FFTW_MEASURE, forwardAligned, inverseAligned);
+        makePlans (FFTW_MEASURE | FFTW_UNALIGNED, forwardUnaligned, inverseUnaligned);
+
+        fftwf_free (buffer);
+
+        if (measured && planner.wisdomFile != juce::File())
+        {
+            planner.wisdomFile.getParentDirectory().createDirectory();
+            fftwf_export_wisdom_to_filename (planner.wisdomFile.getFullPathName().toRawUTF8());
+        }
+    }
+
+    ~FFTWBackend() override
+    {
+        const juce::ScopedLock sl (getPlanner().lock);
+
+        for (auto* plan : { forwardAligned, inverseAligned, forwardUnaligned, inverseUnaligned })
+            fftwf_destroy_plan (plan);
+    }
+
+    void performRealOnlyForwardTransform (float* data) const noexcept override
+    {
+        const auto isAligned = fftwf_alignment_of (data) == alignment;
+        fftwf_execute_dft_r2c (isAligned ? forwardAligned : forwardUnaligned, data, reinterpret_cast<fftwf_complex*> (data));
+    }
+
+    void performRealOnlyInverseTransform (float* data) const noexcept override
+    {
+        const auto isAligned = fftwf_alignment_of (data) == alignment;
+        fftwf_execute_dft_c2r (isAligned ? inverseAligned : inverseUnaligned, reinterpret_cast<fftwf_complex*> (data), data);
+        juce::FloatVectorOperations::multiply (data, 1.0f / (float) size, size);
+    }
+
+private:
+    const int size;
+    int alignment = 0;
+    fftwf_plan forwardAligned = nullptr, inverseAligned = nullptr;
+    fftwf_plan forwardUnaligned = nullptr, inverseUnaligned = nullptr;
+};
+#endif
+
+//==============================================================================
+static std::atomic<FFTBackend::Type> defaultType { CUSTOM_JUCE_USE_FFTW ? FFTBackend::Type::fftw
+                                                                        : FFTBackend::Type::juce };
+
+//==============================================================================
+// Transforms are only ever added, so that the ones handed out stay valid for the
+// lifetime of the process. There are only a few sizes per type. Only FFTW plans
+// are cached, they are immutable and executing them needs no lock.
+struct FFTBackendCache
+{
+    juce::CriticalSection lock;
+    std::map<std::pair<FFTBackend::Type, int>, std::shared_ptr<const FFTBackend>> backends;
+};
+
+static FFTBackendCache& getCache()
+{
+   #if CUSTOM_JUCE_USE_FFTW
+    // constructed first, so that it outlives the plans in the cache
+    getPlanner();
+   #endif
+
+    static FFTBackendCache cache;
+    return cache;
+}
+
+std::shared_ptr<const FFTBackend> FFTBackend::getShared (int order)
+{
+    return getShared (getDefaultType(), order);
+}
+
+std::shared_ptr<const FFTBackend> FFTBackend::getShared (Type type, int order)
+{
+    if (! isAvailable (type))
+        type = Type::juce;
+
+    // juce::dsp::FFT may serialise its transforms (see JuceFFTBackend), so every
+    // engine gets its own instead of every plugin instance contending for one
+    if (type == Type::juce)
+        return create (type, order);
+
+    auto& cache = getCache();
+    const juce::ScopedLock sl (cache.lock);
+
+    auto& backend = cache.backends[{ type, order }];
+
+    if (backend == nullptr)
+        backend = create (type, order);
+
+    return backend;
+}
+
+std::unique_ptr<FFTBackend> FFTBackend::create (int order)
+{
+    return create (getDefaultType(), order);
+}
+
+std::unique_ptr<FFTBackend> FFTBackend::create (Type type, int order)
+{
+   #if CUSTOM_JUCE_USE_FFTW
+    if (type == Type::fftw)
+        return std::make_unique<FFTWBackend> (order);
+   #else
+    juce::ignoreUnused (type);
+   #endif
+
+    return std::make_unique<JuceFFTBackend> (order);
+}
+
+bool FFTBackend::isAvailable (Type type) noexcept
+{
+    return type == Type::juce || (type == Type::fftw && CUSTOM_JUCE_USE_FFTW);
+}
+
+juce::String FFTBackend::getName (Type type)
+{
+    switch (type)
+    {
+        case Type::juce: return "juce";
+        case Type::fftw: return "fftw";
+    }
+
+    return {};
+}
+
+void FFTBackend::setDefaultType (Type type) noexcept
+{
+    defaultType.store (isAvailable (type) ? type : Type::juce);
+}
+
+FFTBackend::Type FFTBackend::getDefaultType() noexcept
+{
+    return defaultType.load();
+}
+
+void FFTBackend::setWisdomFile (const juce::File& file)
+{
+   #if CUSTOM_JUCE_USE_FFTW
+    auto& planner = getPlanner();
+    const juce::ScopedLock sl (planner.lock);
+
+    if (planner.wisdomFile == file)
+        return;
+
+    planner.wisdomFile = file;
+    planner.wisdomLoaded = false;
+   #else
+    juce::ignoreUnused (file);
+   #endif
+}
+
+} // namespace custom_juce
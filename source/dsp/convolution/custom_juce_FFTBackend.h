@@ -0,0 +1,89 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+namespace custom_juce
+{
+/**
+    A real-only FFT of a fixed power of two size, used by the Convolution for all
+    of its transforms.
+
+    The data layout is the one of juce::dsp::FFT: the forward transform takes
+    getSize() real samples and writes the getSize() / 2 + 1 complex bins of the
+    non-negative frequencies, real and imaginary parts interleaved. The inverse
+    transform reads those bins and writes getSize() real samples, scaled by
+    1 / getSize(). The buffers passed in hold 2 * getSize() floats, everything
+    after the bins may be used as scratch space.
+
+    Which implementation is used can be chosen at runtime among the ones that
+    were compiled in. juce::dsp::FFT is always available, it uses IPP or vDSP
+    when JUCE was built with them and a portable fallback otherwise. FFTW is
+    available when built with CUSTOM_JUCE_USE_FFTW=1 (see ORBE_USE_FFTW).
+
+    Transforms are reentrant, a single object may be used from several threads at
+    once. FFTW does so without any lock, which is what lets getShared() hand the
+    same plans to every engine of every plugin instance. Creating and destroying
+    objects is thread safe, but not realtime safe.
+*/
+class FFTBackend
+{
+public:
+    enum class Type { juce, fftw };
+
+    virtual ~FFTBackend() = default;
+
+    virtual void performRealOnlyForwardTransform (float* data) const noexcept = 0;
+    virtual void performRealOnlyInverseTransform (float* data) const noexcept = 0;
+
+    int getOrder() const noexcept   { return order; }
+    int getSize() const noexcept    { return 1 << order; }
+
+    /** Returns a transform of size 2^order of the default type, to be shared by
+        all users of that size.
+
+        FFTW plans come from a cache shared by the whole process. They are only
+        set up once, and all engines borrow them from there, executing them takes
+        no lock. Cached transforms are never destroyed, so releasing one never
+        frees anything. juce::dsp::FFT may lock around its transforms, so its
+        transforms are never shared between callers: every call creates a new
+        one, so that engines and plugin instances don't serialise each other.
+    */
+    static std::shared_ptr<const FFTBackend> getShared (int order);
+
+    /** Like getShared (int), for the given type, or the juce type if that one is
+        not available in this build.
+    */
+    static std::shared_ptr<const FFTBackend> getShared (Type type, int order);
+
+    /** Creates a transform of size 2^order, of the default type. */
+    static std::unique_ptr<FFTBackend> create (int order);
+
+    /** Creates a transform of the given type, or of the juce type if that one is
+        not available in this build.
+    */
+    static std::unique_ptr<FFTBackend> create (Type type, int order);
+
+    static bool isAvailable (Type type) noexcept;
+    static juce::String getName (Type type);
+
+    /** Sets the type that create (int) and getShared (int) use. Only affects
+        transforms requested afterwards, e.g. by engines built for the next impulse
+        response. The default is FFTW when it is available.
+    */
+    static void setDefaultType (Type type) noexcept;
+    static Type getDefaultType() noexcept;
+
+    /** FFTW measures the fastest algorithm for every size once and keeps the result
+        as "wisdom" in this file, so that later runs only load it. Without a file,
+        plans are measured again in every process.
+    */
+    static void setWisdomFile (const juce::File& file);
+
+protected:
+    explicit FFTBackend (int orderIn) noexcept : order (orderIn) {}
+
+private:
+    const int order;
+};
+
+} // namespace custom_juce
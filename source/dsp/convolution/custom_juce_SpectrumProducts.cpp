@@ -0,0 +1,258 @@
+#include "custom_juce_SpectrumProducts.h"
+
+namespace custom_juce
+{
+
+static void multiplyAccumulateScalar (const SpectrumProducts& p, size_t begin) noexcept
+{
+    const auto n = p.numBins;
+
+    for (auto k = begin; k < n; ++k)
+    {
+        auto re = p.partialSum != nullptr ? p.partialSum[k] : 0.0f;
+        auto im = p.partialSum != nullptr ? p.partialSum[k + n] : 0.0f;
+
+        for (size_t i = 0; i < p.numPartitions; ++i)
+        {
+            const auto* x = p.inputs[i];
+            const auto* h = p.impulses[i];
+
+            re += x[k] * h[k] - x[k + n] * h[k + n];
+            im += x[k] * h[k + n] + x[k + n] * h[k];
+        }
+
+        if (p.interleaveOutput)
+        {
+            p.output[2 * k]     = re;
+            p.output[2 * k + 1] = im;
+        }
+        else
+        {
+            p.output[k]     = re;
+            p.output[k + n] = im;
+        }
+    }
+}
+
+#if CUSTOM_JUCE_X86_KERNELS
+CUSTOM_JUCE_TARGET_AVX512
+static void multiplyAccumulateAVX512 (const SpectrumProducts& p) noexcept
+{
+    const auto n = p.numBins;
+    const auto interleaveLow  = _mm512_setr_epi32 (0, 16, 1, 17, 2, 18, 3, 19, 4, 20, 5, 21, 6, 22, 7, 23);
+    const auto interleaveHigh = _mm512_setr_epi32 (8, 24, 9, 25, 10, 26, 11, 27, 12, 28, 13, 29, 14, 30, 15, 31);
+    size_t k = 0;
+
+    for (; k + 16 <= n; k += 16)
+    {
+        // four independent sums, so consecutive partitions don't wait on each other
+        auto reRe = p.partialSum != nullptr ? _mm512_loadu_ps (p.partialSum + k)     : _mm512_setzero_ps();
+        auto reIm = p.partialSum != nullptr ? _mm512_loadu_ps (p.partialSum + k + n) : _mm512_setzero_ps();
+        auto imIm = _mm512_setzero_ps();
+        auto imRe = _mm512_setzero_ps();
+
+        for (size_t i = 0; i < p.numPartitions; ++i)
+        {
+            const auto xRe = _mm512_loadu_ps (p.inputs[i] + k);
+            const auto xIm = _mm512_loadu_ps (p.inputs[i] + k + n);
+            const auto hRe = _mm512_loadu_ps (p.impulses[i] + k);
+            const auto hIm = _mm512_loadu_ps (p.impulses[i] + k + n);
+
+            reRe = _mm512_fmadd_ps (xRe, hRe, reRe);
+            imIm = _mm512_fmadd_ps (xIm, hIm, imIm);
+            reIm = _mm512_fmadd_ps (xRe, hIm, reIm);
+            imRe = _mm512_fmadd_ps (xIm, hRe, imRe);
+        }
+
+        const auto re = _mm512_sub_ps (reRe, imIm);
+        const auto im = _mm512_add_ps (reIm, imRe);
+
+        if (p.interleaveOutput)
+        {
+            _mm512_storeu_ps (p.output + 2 * k,      _mm512_permutex2var_ps (re, interleaveLow, im));
+            _mm512_storeu_ps (p.output + 2 * k + 16, _mm512_permutex2var_ps (re, interleaveHigh, im));
+        }
+        else
+        {
+            _mm512_storeu_ps (p.output + k,     re);
+            _mm512_storeu_ps (p.output + k + n, im);
+        }
+    }
+
+    multiplyAccumulateScalar (p, k);
+}
+
+CUSTOM_JUCE_TARGET_AVX2
+static void multiplyAccumulateAVX2 (const SpectrumProducts& p) noexcept
+{
+    const auto n = p.numBins;
+    size_t k = 0;
+
+    for (; k + 8 <= n; k += 8)
+    {
+        auto reRe = p.partialSum != nullptr ? _mm256_loadu_ps (p.partialSum + k)     : _mm256_setzero_ps();
+        auto reIm = p.partialSum != nullptr ? _mm256_loadu_ps (p.partialSum + k + n) : _mm256_setzero_ps();
+        auto imIm = _mm256_setzero_ps();
+        auto imRe = _mm256_setzero_ps();
+
+        for (size_t i = 0; i < p.numPartitions; ++i)
+        {
+            const auto xRe = _mm256_loadu_ps (p.inputs[i] + k);
+            const auto xIm = _mm256_loadu_ps (p.inputs[i] + k + n);
+            const auto hRe = _mm256_loadu_ps (p.impulses[i] + k);
+            const auto hIm = _mm256_loadu_ps (p.impulses[i] + k + n);
+
+            reRe = _mm256_fmadd_ps (xRe, hRe, reRe);
+            imIm = _mm256_fmadd_ps (xIm, hIm, imIm);
+            reIm = _mm256_fmadd_ps (xRe, hIm, reIm);
+            imRe = _mm256_fmadd_ps (xIm, hRe, imRe);
+        }
+
+        const auto re = _mm256_sub_ps (reRe, imIm);
+        const auto im = _mm256_add_ps (reIm, imRe);
+
+        if (p.interleaveOutput)
+        {
+            const auto low  = _mm256_unpacklo_ps (re, im);
+            const auto high = _mm256_unpackhi_ps (re, im);
+            _mm256_storeu_ps (p.output + 2 * k,     _mm256_permute2f128_ps (low, high, 0x20));
+            _mm256_storeu_ps (p.output + 2 * k + 8, _mm256_permute2f128_ps (low, high, 0x31));
+        }
+        else
+        {
+            _mm256_storeu_ps (p.output + k,     re);
+            _mm256_storeu_ps (p.output + k + n, im);
+        }
+    }
+
+    multiplyAccumulateScalar (p, k);
+}
+
+static void multiplyAccumulateSSE (const SpectrumProducts& p) noexcept
+{
+    const auto n = p.numBins;
+    size_t k = 0;
+
+    for (; k + 4 <= n; k += 4)
+    {
+        auto reRe = p.partialSum != nullptr ? _mm_loadu_ps (p.partialSum + k)     : _mm_setzero_ps();
+        auto reIm = p.partialSum != nullptr ? _mm_loadu_ps (p.partialSum + k + n) : _mm_setzero_ps();
+        auto imIm = _mm_setzero_ps();
+        auto imRe = _mm_setzero_ps();
+
+        for (size_t i = 0; i < p.numPartitions; ++i)
+        {
+            const auto xRe = _mm_loadu_ps (p.inputs[i] + k);
+            const auto xIm = _mm_loadu_ps (p.inputs[i] + k + n);
+            const auto hRe = _mm_loadu_ps (p.impulses[i] + k);
+            const auto hIm = _mm_loadu_ps (p.impulses[i] + k + n);
+
+            reRe = _mm_add_ps (reRe, _mm_mul_ps (xRe, hRe));
+            imIm = _mm_add_ps (imIm, _mm_mul_ps (xIm, hIm));
+            reIm = _mm_add_ps (reIm, _mm_mul_ps (xRe, hIm));
+            imRe = _mm_add_ps (imRe, _mm_mul_ps (xIm, hRe));
+        }
+
+        const auto re = _mm_sub_ps (reRe, imIm);
+        const auto im = _mm_add_ps (reIm, imRe);
+
+        if (p.interleaveOutput)
+        {
+            _mm_storeu_ps (p.output + 2 * k,     _mm_unpacklo_ps (re, im));
+            _mm_storeu_ps (p.output + 2 * k + 4, _mm_unpackhi_ps (re, im));
+        }
+        else
+        {
+            _mm_storeu_ps (p.output + k,     re);
+            _mm_storeu_ps (p.output + k + n, im);
+        }
+    }
+
+    multiplyAccumulateScalar (p, k);
+}
+#elif CUSTOM_JUCE_NEON_KERNELS
+static void multiplyAccumulateNEON (const SpectrumProducts& p) noexcept
+{
+    const auto n = p.numBins;
+    size_t k = 0;
+
+    for (; k + 4 <= n; k += 4)
+    {
+        auto reRe = p.partialSum != nullptr ? vld1q_f32 (p.partialSum + k)     : vdupq_n_f32 (0.0f);
+        auto reIm = p.partialSum != nullptr ? vld1q_f32 (p.partialSum + k + n) : vdupq_n_f32 (0.0f);
+        auto imIm = vdupq_n_f32 (0.0f);
+        auto imRe = vdupq_n_f32 (0.0f);
+
+        for (size_t i = 0; i < p.numPartitions; ++i)
+        {
+            const auto xRe = vld1q_f32 (p.inputs[i] + k);
+            const auto xIm = vld1q_f32 (p.inputs[i] + k + n);
+            const auto hRe = vld1q_f32 (p.impulses[i] + k);
+            const auto hIm = vld1q_f32 (p.impulses[i] + k + n);
+
+            reRe = vmlaq_f32 (reRe, xRe, hRe);
+            imIm = vmlaq_f32 (imIm, xIm, hIm);
+            reIm = vmlaq_f32 (reIm, xRe, hIm);
+            imRe = vmlaq_f32 (imRe, xIm, hRe);
+        }
+
+        const auto re = vsubq_f32 (reRe, imIm);
+        const auto im = vaddq_f32 (reIm, imRe);
+
+        if (p.interleaveOutput)
+        {
+            vst2q_f32 (p.output + 2 * k, (float32x4x2_t { { re, im } }));
+        }
+        else
+        {
+            vst1q_f32 (p.output + k,     re);
+            vst1q_f32 (p.output + k + n, im);
+        }
+    }
+
+    multiplyAccumulateScalar (p, k);
+}
+#endif
+
+void multiplyAccumulateScalar (const SpectrumProducts& p) noexcept
+{
+    multiplyAccumulateScalar (p, 0);
+}
+
+SpectrumKernel getSpectrumKernel() noexcept
+{
+   #if CUSTOM_JUCE_X86_KERNELS
+    if (juce::SystemStats::hasAVX512F())
+        return multiplyAccumulateAVX512;
+
+    if (juce::SystemStats::hasAVX2() && juce::SystemStats::hasFMA3())
+        return multiplyAccumulateAVX2;
+
+    return multiplyAccumulateSSE;
+   #elif CUSTOM_JUCE_NEON_KERNELS
+    return multiplyAccumulateNEON;
+   #else
+    return multiplyAccumulateScalar;
+   #endif
+}
+
+std::vector<NamedSpectrumKernel> getAvailableSpectrumKernels()
+{
+    std::vector<NamedSpectrumKernel> kernels { { "scalar", multiplyAccumulateScalar } };
+
+   #if CUSTOM_JUCE_X86_KERNELS
+    kernels.push_back ({ "SSE", multiplyAccumulateSSE });
+
+    if (juce::SystemStats::hasAVX2() && juce::SystemStats::hasFMA3())
+        kernels.push_back ({ "AVX2", multiplyAccumulateAVX2 });
+
+    if (juce::SystemStats::hasAVX512F())
+        kernels.push_back ({ "AVX-512", multiplyAccumulateAVX512 });
+   #elif CUSTOM_JUCE_NEON_KERNELS
+    kernels.push_back ({ "NEON", multiplyAccumulateNEON });
+   #endif
+
+    return kernels;
+}
+
+} // namespace custom_juce
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+#if defined (__x86_64__) || defined (_M_X64) || defined (__SSE2__) || (defined (_M_IX86_FP) && _M_IX86_FP == 2)
+ #include <immintrin.h>
+ #define CUSTOM_JUCE_X86_KERNELS 1
+
+ #if JUCE_MSVC
+  #define CUSTOM_JUCE_TARGET_AVX2
+  #define CUSTOM_JUCE_TARGET_AVX512
+ #else
+  #define CUSTOM_JUCE_TARGET_AVX2   __attribute__ ((target ("avx2,fma")))
+  #define CUSTOM_JUCE_TARGET_AVX512 __attribute__ ((target ("avx512f")))
+ #endif
+#elif defined (__ARM_NEON__) || defined (__ARM_NEON) || defined (_M_ARM64)
+ #include <arm_neon.h>
+ #define CUSTOM_JUCE_NEON_KERNELS 1
+#endif
+
+namespace custom_juce
+{
+// Complex multiply-accumulate of partitioned spectra, the inner loop of the
+// ConvolutionEngine. The spectra are in the split layout made by
+// ConvolutionEngine::prepareForConvolution: fftSize / 2 real parts, then as many
+// imaginary parts, then the real Nyquist bin. All partitions are summed per group
+// of bins while the sums stay in registers, so the result is written only once.
+// It is written either in the same split layout, or interleaved, ready for the
+// inverse transform. The x86 kernels are compiled for their instruction set only
+// and picked at runtime.
+struct SpectrumProducts
+{
+    const float* const* inputs;
+    const float* const* impulses;
+    size_t numPartitions;
+    // added to the sum if not null, in the split layout
+    const float* partialSum;
+    float* output;
+    size_t numBins;
+    bool interleaveOutput;
+};
+
+using SpectrumKernel = void (*) (const SpectrumProducts&);
+
+/** The plain C++ version, which the SIMD kernels have to match. */
+void multiplyAccumulateScalar (const SpectrumProducts& products) noexcept;
+
+/** The fastest kernel this CPU can run. */
+SpectrumKernel getSpectrumKernel() noexcept;
+
+struct NamedSpectrumKernel
+{
+    const char* name;
+    SpectrumKernel kernel;
+};
+
+/** Every kernel this CPU can run, starting with the scalar one, e.g. to check
+    them against each other.
+*/
+std::vector<NamedSpectrumKernel> getAvailableSpectrumKernels();
+
+} // namespace custom_juce
@@ -7,6 +7,28 @@
 ParameterComponent::ParameterComponent(AudioPluginAudioProcessor &processor) : processorRef(processor) {
     genericParameter = std::make_unique<CustomGenericAudioProcessorEditor>(processorRef);
     addAndMakeVisible(*genericParameter);
+
+    loadSofaButton.setTooltip(processorRef.getExternalSofaFile().getFullPathName());
+    loadSofaButton.onClick = [this] { chooseSofaFile(); };
+    addAndMakeVisible(loadSofaButton);
+}
+
+void ParameterComponent::chooseSofaFile() {
+    sofaChooser = std::make_unique<juce::FileChooser>("Select a SOFA file", processorRef.getExternalSofaFile(), "*.sofa");
+
+    sofaChooser->launchAsync(juce::FileBrowserComponent::openMode | juce::FileBrowserComponent::canSelectFiles, [this] (const juce::FileChooser& chooser)
+    {
+        auto file = chooser.getResult();
+        if (! file.existsAsFile())
+            return;
+
+        processorRef.setExternalSofaFile(file);
+        loadSofaButton.setTooltip(file.getFullPathName());
+
+        // switch to the file, it is swapped in once it has been loaded
+        auto* sofaChoice = processorRef.getValueTreeState().getParameter(PluginParameters::SOFA_CHOICE_ID.getParamID());
+        sofaChoice->setValueNotifyingHost(sofaChoice->convertTo0to1(static_cast<float>(sofaChoices::external)));
+    });
 }
 
 void ParameterComponent::paint(juce::Graphics &g) {
@@ -24,6 +46,9 @@ void ParameterComponent::resized() {
     auto bounds = getLocalBounds();
     auto headerBounds = bounds.removeFromTop(static_cast<int>((float)getHeight() * 0.2f));
     bounds.removeFromBottom(10);
+
+    auto buttonBounds = headerBounds.removeFromRight(headerBounds.getWidth() / 4);
+    loadSofaButton.setBounds(buttonBounds.withSizeKeepingCentre(buttonBounds.getWidth() - 20, 24));
     auto paramBounds = bounds;
 
     genericParameter->setBounds(paramBounds);
@@ -29,9 +29,14 @@ public:
     void resized() override;
 
 private:
+    void chooseSofaFile();
+
     AudioPluginAudioProcessor& processorRef;
     std::unique_ptr<CustomGenericAudioProcessorEditor> genericParameter;
 
+    juce::TextButton loadSofaButton { "Load SOFA..." };
+    std::unique_ptr<juce::FileChooser> sofaChooser;
+
     juce::LookAndFeel_V4 lf;
 
     std::unique_ptr<juce::Drawable> orbeLogo = juce::Drawable::createFromImageData(BinaryData::orbe_svg, BinaryData::orbe_svgSize);